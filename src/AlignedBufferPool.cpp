@@ -0,0 +1,121 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "AlignedBufferPool.h"
+
+#include <cstdlib>
+#include <new>
+
+constexpr size_t AlignedBufferPool::Alignment;
+
+static size_t alignUp(size_t size) {
+    return (size + AlignedBufferPool::Alignment - 1) / AlignedBufferPool::Alignment * AlignedBufferPool::Alignment;
+}
+
+static char* allocateAligned(size_t capacity) {
+    void* data;
+    if (posix_memalign(&data, AlignedBufferPool::Alignment, capacity) != 0) {
+        throw std::bad_alloc();
+    }
+
+    return (char*) data;
+}
+
+AlignedBufferPool::Buffer::Buffer() :
+        pool_(nullptr),
+        data_(nullptr),
+        capacity_(0) {
+}
+
+AlignedBufferPool::Buffer::Buffer(AlignedBufferPool* pool, char* data, size_t capacity) :
+        pool_(pool),
+        data_(data),
+        capacity_(capacity) {
+}
+
+AlignedBufferPool::Buffer::Buffer(Buffer&& other) noexcept :
+        pool_(other.pool_),
+        data_(other.data_),
+        capacity_(other.capacity_) {
+    other.data_ = nullptr;
+}
+
+AlignedBufferPool::Buffer& AlignedBufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        if (data_) {
+            pool_->release(data_, capacity_);
+        }
+
+        pool_ = other.pool_;
+        data_ = other.data_;
+        capacity_ = other.capacity_;
+        other.data_ = nullptr;
+    }
+
+    return *this;
+}
+
+AlignedBufferPool::Buffer::~Buffer() {
+    if (data_) {
+        pool_->release(data_, capacity_);
+    }
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t bufferSize, size_t maxPooledBuffers) :
+        bufferSize_(alignUp(bufferSize)),
+        maxPooledBuffers_(maxPooledBuffers),
+        mutex_(),
+        freeBuffers_() {
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (char* data : freeBuffers_) {
+        free(data);
+    }
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::get(size_t minCapacity) {
+    if (minCapacity > bufferSize_) {
+        return Buffer(this, allocateAligned(alignUp(minCapacity)), alignUp(minCapacity));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!freeBuffers_.empty()) {
+            char* data = freeBuffers_.back();
+            freeBuffers_.pop_back();
+            return Buffer(this, data, bufferSize_);
+        }
+    }
+
+    return Buffer(this, allocateAligned(bufferSize_), bufferSize_);
+}
+
+void AlignedBufferPool::release(char* data, size_t capacity) {
+    if (capacity == bufferSize_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (freeBuffers_.size() < maxPooledBuffers_) {
+            freeBuffers_.push_back(data);
+            return;
+        }
+    }
+
+    free(data);
+}
@@ -0,0 +1,82 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * Pool of memory buffers aligned for O_DIRECT I/O
+ */
+class AlignedBufferPool {
+public:
+    static constexpr size_t Alignment = 4096;
+
+    class Buffer {
+    public:
+        Buffer();
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer();
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        char* data() const {
+            return data_;
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+    private:
+        Buffer(AlignedBufferPool* pool, char* data, size_t capacity);
+
+        AlignedBufferPool* pool_;
+        char* data_;
+        size_t capacity_;
+
+        friend class AlignedBufferPool;
+    };
+
+    /**
+     * @param bufferSize size of the pooled buffers
+     * @param maxPooledBuffers max number of buffers kept in the pool when they're not in use
+     */
+    AlignedBufferPool(size_t bufferSize, size_t maxPooledBuffers);
+    ~AlignedBufferPool();
+
+    /**
+     * Get a buffer of at least the given capacity. Buffers bigger than the pooled size are not recycled.
+     */
+    Buffer get(size_t minCapacity);
+
+private:
+    void release(char* data, size_t capacity);
+
+    const size_t bufferSize_;
+    const size_t maxPooledBuffers_;
+
+    std::mutex mutex_;
+    std::vector<char*> freeBuffers_;
+};
@@ -19,34 +19,139 @@
  *
  */
 #include "Bookie.h"
+#include "CpuAffinity.h"
 #include "Logging.h"
+#include "PayloadArena.h"
 
+#include <boost/filesystem.hpp>
 #include <folly/io/async/EventBaseManager.h>
 #include <wangle/channel/EventBaseHandler.h>
 #include <folly/Bits.h>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Hash.h>
+#include <folly/String.h>
+
+namespace fs = boost::filesystem;
 
 DECLARE_LOG_OBJECT();
 
+static size_t ioThreadCount(const BookieConfig& conf) {
+    return conf.numIoThreads() > 0 ? conf.numIoThreads() : std::thread::hardware_concurrency();
+}
+
+/**
+ * The ledgers are partitioned by the number of shards, which can't change once the data directory is in use
+ */
+static void checkShardLayout(const BookieConfig& conf) {
+    fs::create_directories(conf.dataDirectory());
+    std::string path = conf.dataDirectory() + "/shards";
+
+    std::string content;
+    if (readFile(path.c_str(), content)) {
+        int numShards = to<int>(trimWhitespace(content));
+        if (numShards != conf.numShards()) {
+            LOG_FATAL("The data directory was created with numShards " << numShards << " -- configured: " //
+                    << conf.numShards());
+            std::exit(1);
+        }
+        return;
+    }
+
+    if (conf.numShards() > 0 && fs::exists(conf.dataDirectory() + "/index")) {
+        LOG_FATAL("The data directory was created without storage shards -- configured numShards: " //
+                << conf.numShards());
+        std::exit(1);
+    }
+
+    if (!writeFile(to<std::string>(conf.numShards()), path.c_str())) {
+        LOG_FATAL("Failed to write " << path);
+        std::exit(1);
+    }
+}
+
 Bookie::Bookie(const BookieConfig& conf) :
         conf_(conf),
         metricsManager_(conf.statsReportingInterval()),
         zk_(conf.zkServers(), milliseconds(conf.zkSessionTimeout())),
         bookieRegistration_(&zk_, conf),
-        storage_(conf, metricsManager_) {
+        storage_(),
+        shardsMemoryAccountant_(),
+        shards_(),
+        readExecutor_() {
+    checkShardLayout(conf);
+
+    if (conf.numShards() > 0) {
+        LOG_INFO("Starting " << conf.numShards() << " storage shards");
+        std::vector<int> cpus = CpuAffinity::threadCpus(conf.shardThreadsCpus(), conf.numaNode());
+
+        // The memory limit is for the whole bookie, whichever shards the entries go to
+        shardsMemoryAccountant_.reset(
+                new MemoryAccountant(conf.memoryLimit(), metricsManager_, "", &PayloadArena::pinnedToUsedRatio));
+
+        for (int i = 0; i < conf.numShards(); i++) {
+            int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+            shards_.emplace_back(
+                    new StorageShard(i, ioThreadCount(conf), cpu, conf, metricsManager_, *shardsMemoryAccountant_));
+        }
+    } else {
+        storage_.reset(new Storage(conf, metricsManager_));
+        readExecutor_ = std::make_shared<CPUThreadPoolExecutor>(conf.numReadThreads(),
+                std::make_shared<PinnedThreadFactory>("bookie-read",
+                        CpuAffinity::threadCpus(conf.storageThreadsCpus(), conf.numaNode())));
+    }
+
     server_.childPipeline(std::make_shared<BookiePipelineFactory>(*this));
+    if (!conf.localTransportPath().empty()) {
+        localServer_.childPipeline(std::make_shared<BookieLocalPipelineFactory>(*this));
+    }
+
+    metricsManager_.registerGauge("payloadPinnedToUsedRatio", &PayloadArena::pinnedToUsedRatio);
 }
 
 void Bookie::start() {
     SocketAddress bookieAddress("0.0.0.0", conf_.bookiePort());
     LOG_INFO("Starting bookie on " << bookieAddress);
+
+    size_t numIoThreads = ioThreadCount(conf_);
+    std::vector<int> ioCpus = CpuAffinity::threadCpus(conf_.ioThreadsCpus(), conf_.numaNode());
+
+    // With SO_REUSEPORT, each acceptor thread has its own listening socket and the kernel spreads the connections
+    // across them. The acceptor threads are pinned to the same CPUs as the IO threads.
+    size_t numAcceptors = conf_.reusePortAcceptors() ? numIoThreads : 1;
+    LOG_INFO("Using " << numIoThreads << " IO threads and " << numAcceptors << " acceptor threads");
+
+    auto ioGroup = std::make_shared<IOThreadPoolExecutor>(numIoThreads,
+            std::make_shared<PinnedThreadFactory>("bookie-io", ioCpus));
+    server_.group(
+            std::make_shared<IOThreadPoolExecutor>(numAcceptors,
+                    std::make_shared<PinnedThreadFactory>("bookie-accept", ioCpus)),
+            ioGroup);
+    server_.setReusePort(conf_.reusePortAcceptors());
     server_.bind(bookieAddress);
 
+    if (!conf_.localTransportPath().empty()) {
+        // The local connections are served by the same IO threads. Remove the socket left by a previous run.
+        fs::remove(conf_.localTransportPath());
+        SocketAddress localAddress = SocketAddress::makeFromPath(conf_.localTransportPath());
+        LOG_INFO("Accepting local clients on " << conf_.localTransportPath());
+
+        localServer_.group(
+                std::make_shared<IOThreadPoolExecutor>(1,
+                        std::make_shared<PinnedThreadFactory>("bookie-local-accept", ioCpus)),
+                ioGroup);
+        localServer_.bind(localAddress);
+    }
+
     zk_.startSession();
     LOG_INFO("Started bookie");
 }
 
 void Bookie::stop() {
     server_.stop();
+    if (!conf_.localTransportPath().empty()) {
+        localServer_.stop();
+    }
 }
 
 void Bookie::waitForStop() {
@@ -57,13 +162,204 @@ BookieHandler Bookie::newHandler() {
     return BookieHandler(*this, metricsManager_);
 }
 
-Future<Unit> Bookie::addEntry(int64_t ledgerId, int64_t entryId, IOBufPtr data) {
-    return storage_.put(ledgerId, entryId, std::move(data));
+std::shared_ptr<WriteCoalescingHandler> Bookie::newWriteCoalescingHandler() {
+    return std::make_shared<WriteCoalescingHandler>(metricsManager_);
+}
+
+std::shared_ptr<LocalTransportHandler> Bookie::newLocalTransportHandler() {
+    return std::make_shared<LocalTransportHandler>(conf_.localTransportRingSize());
+}
+
+size_t Bookie::shardIndex(int64_t ledgerId) const {
+    // Use the high bits of the hash, the storage picks the journal of the ledger from the low ones
+    return (twang_mix64(ledgerId) >> 32) % shards_.size();
+}
+
+StorageShard& Bookie::shardFor(int64_t ledgerId) {
+    return *shards_[shardIndex(ledgerId)];
+}
+
+template<typename Operation>
+auto Bookie::onShard(StorageShard& shard, Operation operation)
+        -> Future<decltype(operation(std::declval<Storage&>()))> {
+    typedef decltype(operation(std::declval<Storage&>())) Result;
+
+    Promise<Result> promise;
+    Future<Result> future = promise.getFuture();
+
+    bool queued = shard.submit([&shard, promise = std::move(promise), operation = std::move(operation)]() mutable {
+        promise.setWith([&] {
+            return operation(shard.storage());
+        });
+    });
+
+    if (!queued) {
+        return makeFuture<Result>(std::runtime_error("Storage shard queue is full"));
+    }
+
+    return future;
+}
+
+template<typename Operation>
+auto Bookie::withStorage(int64_t ledgerId, Operation operation)
+        -> Future<decltype(operation(std::declval<Storage&>()))> {
+    typedef decltype(operation(std::declval<Storage&>())) Result;
+
+    Future<Result> future = shards_.empty() ?
+            via(readExecutor_.get()).then([this, operation = std::move(operation)]() mutable {
+                return operation(*storage_);
+            }) : onShard(shardFor(ledgerId), std::move(operation));
+
+    EventBase* eventBase = EventBaseManager::get()->getExistingEventBase();
+    if (!eventBase) {
+        return future;
+    }
+
+    return std::move(future).via(eventBase);
+}
+
+bool Bookie::addEntry(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion) {
+    if (shards_.empty()) {
+        return storage_->put(ledgerId, entryId, std::move(data), std::move(completion));
+    }
+
+    StorageShard& shard = shardFor(ledgerId);
+    return shard.submit([&shard, ledgerId, entryId, data = std::move(data),
+            completion = std::move(completion)]() mutable {
+        // The callback is kept to reject the entry if the journal doesn't take it
+        EventBase* eventBase = completion.eventBase;
+        auto callback = std::make_shared<Function<void(AddStatus status)>>(std::move(completion.callback));
+
+        // An overloaded shard rejects the adds of its ledgers, without holding back the connections
+        bool queued = !shard.storage().isOverloaded()
+                && shard.storage().put(ledgerId, entryId, std::move(data), AddCompletion { eventBase,
+                    [callback](AddStatus status) {
+                        (*callback)(status);
+                    } });
+
+        if (!queued) {
+            eventBase->runInEventBaseThread([callback] {
+                (*callback)(AddStatus::Rejected);
+            });
+        }
+    });
+}
+
+Future<std::vector<AddStatus>> Bookie::addEntries(std::vector<EntryPayload> entries) {
+    std::vector<LogEntry> logEntries;
+    logEntries.reserve(entries.size());
+    for (EntryPayload& entry : entries) {
+        logEntries.emplace_back(LogEntry { entry.ledgerId, entry.entryId, std::move(entry.data), 0 });
+    }
+
+    if (shards_.empty()) {
+        return storage_->putEntries(std::move(logEntries));
+    }
+
+    // Split the entries by shard, remembering their position in the request
+    std::vector<std::vector<LogEntry>> shardEntries(shards_.size());
+    std::vector<std::vector<size_t>> shardIndexes(shards_.size());
+
+    for (size_t i = 0; i < logEntries.size(); i++) {
+        size_t shard = shardIndex(logEntries[i].ledgerId);
+        shardEntries[shard].emplace_back(std::move(logEntries[i]));
+        shardIndexes[shard].push_back(i);
+    }
+
+    std::vector<Future<std::vector<AddStatus>>> futures;
+    std::vector<size_t> shards;
+    for (size_t shard = 0; shard < shards_.size(); shard++) {
+        if (!shardEntries[shard].empty()) {
+            auto putEntries = [entries = std::move(shardEntries[shard])](Storage& storage) mutable {
+                if (storage.isOverloaded()) {
+                    return makeFuture(std::vector<AddStatus>(entries.size(), AddStatus::Rejected));
+                }
+
+                return storage.putEntries(std::move(entries));
+            };
+            futures.push_back(onShard(*shards_[shard], std::move(putEntries)).unwrap());
+            shards.push_back(shard);
+        }
+    }
+
+    size_t count = logEntries.size();
+    return collectAll(futures).then(
+            [count, shards = std::move(shards), shardIndexes = std::move(shardIndexes)](
+                    const std::vector<Try<std::vector<AddStatus>>>& results) {
+                // The entries of a shard whose queue is full are rejected
+                std::vector<AddStatus> statuses(count, AddStatus::Rejected);
+
+                for (size_t i = 0; i < results.size(); i++) {
+                    if (results[i].hasValue()) {
+                        const std::vector<size_t>& indexes = shardIndexes[shards[i]];
+                        for (size_t j = 0; j < indexes.size(); j++) {
+                            statuses[indexes[j]] = results[i].value()[j];
+                        }
+                    }
+                }
+
+                return statuses;
+            });
+}
+
+bool Bookie::isOverloaded() const {
+    // The connections are shared by all the shards, an overloaded shard rejects the adds of its own ledgers instead
+    // of pausing them
+    return shards_.empty() && storage_->isOverloaded();
+}
+
+bool Bookie::canResumeAdds() const {
+    return !shards_.empty() || storage_->canResumeAdds();
+}
+
+bool Bookie::rejectAddsWhenOverloaded() const {
+    return conf_.rejectAddsWhenOverloaded();
+}
+
+/**
+ * Tell a missing ledger from a missing entry. Only done for the misses, since loading a cold ledger reads the index.
+ */
+static BookieError missingEntryError(Storage& storage, int64_t ledgerId) {
+    LedgerInfo info;
+    return storage.getLedgerInfo(ledgerId, info) ? BookieError::NoEntry : BookieError::NoLedger;
+}
+
+Future<ReadResult> Bookie::getLastEntry(int64_t ledgerId) {
+    return withStorage(ledgerId, [=](Storage& storage) {
+        LedgerInfo info;
+        IOBufPtr data = storage.getLedgerInfo(ledgerId, info) ? storage.get(ledgerId, info.lastEntryId) : IOBufPtr();
+        BookieError errorCode = data ? BookieError::OK : BookieError::NoLedger;
+        return ReadResult { errorCode, std::move(data), { } };
+    });
+}
+
+Future<bool> Bookie::waitForEntry(int64_t ledgerId, int64_t previousEntryId, milliseconds timeout) {
+    if (shards_.empty()) {
+        return storage_->waitForEntry(ledgerId, previousEntryId, timeout);
+    }
+
+    // Registering the waiter can load the ledger from the index, which is owned by the shard thread
+    return onShard(shardFor(ledgerId), [=](Storage& storage) {
+        return storage.waitForEntry(ledgerId, previousEntryId, timeout);
+    }).unwrap();
 }
 
-Future<IOBufPtr> Bookie::getLastEntry(int64_t ledgerId) {
+Future<ReadResult> Bookie::readEntry(int64_t ledgerId, int64_t entryId) {
+    return withStorage(ledgerId, [=](Storage& storage) {
+        IOBufPtr data = storage.get(ledgerId, entryId);
+        BookieError errorCode = data ? BookieError::OK : missingEntryError(storage, ledgerId);
+        return ReadResult { errorCode, std::move(data), { } };
+    });
 }
 
-Future<IOBufPtr> Bookie::readEntry(int64_t ledgerId, int64_t entryId) {
+Future<ReadResult> Bookie::readEntries(int64_t ledgerId, int64_t firstEntryId, int maxCount, size_t maxBytes) {
+    return withStorage(ledgerId, [=](Storage& storage) {
+        std::vector<IOBufPtr> entries;
+        if (!storage.getRange(ledgerId, firstEntryId, maxCount, maxBytes, entries)) {
+            return ReadResult { BookieError::BadRequest, nullptr, { } };
+        }
 
+        BookieError errorCode = entries.empty() ? missingEntryError(storage, ledgerId) : BookieError::OK;
+        return ReadResult { errorCode, nullptr, std::move(entries) };
+    });
 }
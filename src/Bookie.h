@@ -21,6 +21,7 @@
 #pragma once
 
 #include <wangle/bootstrap/ServerBootstrap.h>
+#include <wangle/concurrent/CPUThreadPoolExecutor.h>
 #include <iostream>
 
 #include "BookiePipeline.h"
@@ -28,11 +29,23 @@
 #include "ZooKeeper.h"
 #include "BookieHandler.h"
 #include "BookieConfig.h"
+#include "LocalTransportHandler.h"
 #include "Metrics.h"
 #include "Storage.h"
+#include "StorageShard.h"
+#include "WriteCoalescingHandler.h"
 
 using namespace wangle;
 
+/**
+ * Entries read for a request, or the reason why there are none
+ */
+struct ReadResult {
+    BookieError errorCode;
+    IOBufPtr data;
+    std::vector<IOBufPtr> entries;
+};
+
 class Bookie {
 public:
     explicit Bookie(const BookieConfig& conf);
@@ -45,19 +58,91 @@ public:
 
     BookieHandler newHandler();
 
-    Future<Unit> addEntry(int64_t ledgerId, int64_t entryId, IOBufPtr data);
+    std::shared_ptr<WriteCoalescingHandler> newWriteCoalescingHandler();
+
+    std::shared_ptr<LocalTransportHandler> newLocalTransportHandler();
+
+    /**
+     * Add an entry. The completion callback is invoked in the given event base once the entry is durable.
+     *
+     * @return false if the entry could not be queued, in which case the callback is not invoked. In partitioned
+     * mode, the shard thread can still reject the entry afterwards, through the callback, when the shard is
+     * overloaded.
+     */
+    bool addEntry(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion);
+
+    /**
+     * Add multiple entries at once. The future is set with the outcome of each entry.
+     */
+    Future<std::vector<AddStatus>> addEntries(std::vector<EntryPayload> entries);
+
+    /**
+     * @return whether too many entries are being added, in which case no more adds should be accepted. Always false
+     * in partitioned mode, where each shard rejects the adds of its own ledgers instead.
+     */
+    bool isOverloaded() const;
+
+    /**
+     * @return whether the adds can be accepted again, after having been overloaded
+     */
+    bool canResumeAdds() const;
 
-    Future<IOBufPtr> getLastEntry(int64_t ledgerId);
+    bool rejectAddsWhenOverloaded() const;
 
-    Future<IOBufPtr> readEntry(int64_t ledgerId, int64_t entryId);
+    /**
+     * Read the last entry stored for the ledger, with NoLedger if the ledger has no entries
+     */
+    Future<ReadResult> getLastEntry(int64_t ledgerId);
+
+    /**
+     * Wait until the ledger has a durable entry after previousEntryId. The future is set to false if the timeout
+     * expires first.
+     */
+    Future<bool> waitForEntry(int64_t ledgerId, int64_t previousEntryId, milliseconds timeout);
+
+    /**
+     * Read an entry, with NoEntry or NoLedger if it doesn't exist
+     */
+    Future<ReadResult> readEntry(int64_t ledgerId, int64_t entryId);
+
+    /**
+     * Read consecutive entries, up to the given count and total size. There are no entries if the first entry doesn't
+     * exist, with NoEntry or NoLedger, or if it's larger than maxBytes, with BadRequest.
+     */
+    Future<ReadResult> readEntries(int64_t ledgerId, int64_t firstEntryId, int maxCount, size_t maxBytes);
 
 private:
+    size_t shardIndex(int64_t ledgerId) const;
+    StorageShard& shardFor(int64_t ledgerId);
+
+    /**
+     * Run a storage operation on the shard thread. The future is set with the result of the operation.
+     */
+    template<typename Operation>
+    auto onShard(StorageShard& shard, Operation operation) -> Future<decltype(operation(std::declval<Storage&>()))>;
+
+    /**
+     * Run a storage operation for a ledger: on the thread of the shard owning the ledger in partitioned mode, on the
+     * read threads otherwise. The future is completed back on the calling event base.
+     */
+    template<typename Operation>
+    auto withStorage(int64_t ledgerId, Operation operation)
+            -> Future<decltype(operation(std::declval<Storage&>()))>;
+
     const BookieConfig& conf_;
     MetricsManager metricsManager_;
     ServerBootstrap<BookiePipeline> server_;
+    ServerBootstrap<BookiePipeline> localServer_;
 
     ZooKeeper zk_;
     BookieRegistration bookieRegistration_;
-    Storage storage_;
+
+    // Either a single storage, or the storage shards in partitioned mode, with their shared memory budget
+    std::unique_ptr<Storage> storage_;
+    std::unique_ptr<MemoryAccountant> shardsMemoryAccountant_;
+    std::vector<std::unique_ptr<StorageShard>> shards_;
+
+    // Serves the reads of the single storage, which would otherwise block the IO threads on the index and the disk
+    std::shared_ptr<CPUThreadPoolExecutor> readExecutor_;
 };
 
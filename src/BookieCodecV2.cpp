@@ -24,38 +24,45 @@
 
 DECLARE_LOG_OBJECT();
 
-struct PacketHeader {
-    int8_t version;
-    BookieOperation opCode;
-    int16_t flags;
+constexpr size_t BookieClientCodecV2::AddEntryHeaderSize;
+
+void BookieServerCodecV2::read(Context* ctx, IOBufQueue& queue) {
+    // Decode all the complete frames received so far, in place in the socket read buffers
+    while (queue.chainLength() >= sizeof(int32_t)) {
+        io::Cursor reader { queue.front() };
+        uint32_t frameSize = reader.readBE<int32_t>();
+        if (frameSize < sizeof(int32_t) || frameSize > BookieConstant::MaxFrameSize) {
+            LOG_WARN("Invalid frame size: " << frameSize);
+            ctx->fireClose();
+            return;
+        }
 
-    static PacketHeader fromInt(int value) {
-        PacketHeader hdr;
-        hdr.version = value >> 24;
-        hdr.opCode = (BookieOperation) ((value >> 16) & 0xFF);
-        hdr.flags = value & 0xFF;
-        return hdr;
-    }
+        if (queue.chainLength() < sizeof(int32_t) + frameSize) {
+            // Wait for the rest of the frame
+            return;
+        }
 
-    int toInt() const {
-        return ((version & 0xFF) << 24) | (((int8_t) opCode & 0xFF) << 16) | ((int16_t) flags & 0xFFFF);
-    }
-};
+        Request request;
+        bool valid = decoder_.decode(reader, frameSize, request);
+        queue.trimStart(sizeof(int32_t) + frameSize);
+        if (!valid) {
+            ctx->fireClose();
+            return;
+        }
 
-void BookieServerCodecV2::read(Context* ctx, IOBufPtr buf) {
-    if (!buf) {
-        return;
+        LOG_DEBUG("Deserialized request: " << request);
+        ctx->fireRead(std::move(request));
     }
+}
 
-    io::Cursor reader { buf.get() };
-    if (reader.totalLength() < sizeof(int32_t)) {
-        // Short request
-        ctx->fireClose();
-        return;
-    }
+BookieRequestDecoder::BookieRequestDecoder(bool shareLargePayloads) :
+        payloadArena_(shareLargePayloads) {
+}
 
-    Request request;
+bool BookieRequestDecoder::decode(io::Cursor& reader, size_t frameSize, Request& request) {
+    size_t remaining = frameSize;
     PacketHeader hdr = PacketHeader::fromInt(reader.readBE<int32_t>());
+    remaining -= sizeof(int32_t);
     request.protocolVersion = hdr.version;
     request.opCode = hdr.opCode;
     request.flags = hdr.flags;
@@ -63,27 +70,26 @@ void BookieServerCodecV2::read(Context* ctx, IOBufPtr buf) {
     switch (request.opCode) {
     case BookieOperation::AddEntry:
         static const int32_t addRequestSize = BookieConstant::MasterKeyLength + 2 * sizeof(int64_t);
-        if (reader.totalLength() < addRequestSize) {
+        if (remaining < addRequestSize) {
             LOG_WARN(
-                    "Invalid add entry request size: " << reader.totalLength() << " -- expecting at least: " << addRequestSize);
-            ctx->fireClose();
-            return;
+                    "Invalid add entry request size: " << remaining << " -- expecting at least: " << addRequestSize);
+            return false;
         }
         reader.skip(BookieConstant::MasterKeyLength);
         request.ledgerId = reader.readBE<int64_t>();
         request.entryId = reader.readBE<int64_t>();
+        remaining -= addRequestSize;
 
-        reader.clone(request.data, reader.totalLength());
+        request.data = payloadArena_.read(reader, remaining);
         break;
 
     case BookieOperation::ReadEntry: {
         const int32_t readRequestSize = 2 * sizeof(int64_t)
                 + (request.isFencing() ? BookieConstant::MasterKeyLength : 0);
-        if (reader.totalLength() < readRequestSize) {
+        if (remaining < readRequestSize) {
             LOG_WARN(
-                    "Invalid read entry request size: " << reader.totalLength() << " -- expecting: " << readRequestSize);
-            ctx->fireClose();
-            return;
+                    "Invalid read entry request size: " << remaining << " -- expecting: " << readRequestSize);
+            return false;
         }
 
         request.ledgerId = reader.readBE<int64_t>();
@@ -95,50 +101,146 @@ void BookieServerCodecV2::read(Context* ctx, IOBufPtr buf) {
         }
         break;
     }
+    case BookieOperation::BatchReadEntry: {
+        const int32_t batchReadRequestSize = 2 * sizeof(int64_t) + 2 * sizeof(int32_t);
+        if (remaining < batchReadRequestSize) {
+            LOG_WARN("Invalid batch read request size: " << remaining //
+                    << " -- expecting: " << batchReadRequestSize);
+            return false;
+        }
+
+        request.ledgerId = reader.readBE<int64_t>();
+        request.entryId = reader.readBE<int64_t>();
+        request.maxCount = reader.readBE<int32_t>();
+        request.maxBytes = reader.readBE<int32_t>();
+        break;
+    }
+    case BookieOperation::LongPollReadLastEntry: {
+        const int32_t longPollRequestSize = 2 * sizeof(int64_t) + sizeof(int32_t);
+        if (remaining < longPollRequestSize) {
+            LOG_WARN("Invalid long-poll read request size: " << remaining //
+                    << " -- expecting: " << longPollRequestSize);
+            return false;
+        }
+
+        request.ledgerId = reader.readBE<int64_t>();
+        request.entryId = reader.readBE<int64_t>();
+        request.timeoutMillis = reader.readBE<int32_t>();
+        break;
+    }
+    case BookieOperation::MultiAddEntry: {
+        static const size_t entryHeaderSize = 2 * sizeof(int64_t) + sizeof(int32_t);
+        if (remaining < sizeof(int32_t)) {
+            LOG_WARN("Invalid multi-add request size: " << remaining);
+            return false;
+        }
+
+        int32_t count = reader.readBE<int32_t>();
+        remaining -= sizeof(int32_t);
+        if (count <= 0 || (size_t) count > remaining / entryHeaderSize) {
+            LOG_WARN("Invalid multi-add entries count: " << count);
+            return false;
+        }
+
+        request.entries.reserve(count);
+        for (int32_t i = 0; i < count; i++) {
+            if (remaining < entryHeaderSize) {
+                LOG_WARN("Truncated multi-add request at entry " << i << " of " << count);
+                return false;
+            }
+
+            EntryPayload entry;
+            entry.ledgerId = reader.readBE<int64_t>();
+            entry.entryId = reader.readBE<int64_t>();
+            uint32_t size = reader.readBE<int32_t>();
+            remaining -= entryHeaderSize;
+            if (remaining < size) {
+                LOG_WARN("Truncated multi-add request at entry " << i << " of " << count);
+                return false;
+            }
+            remaining -= size;
+
+            entry.data = payloadArena_.read(reader, size);
+            request.entries.emplace_back(std::move(entry));
+        }
+
+        request.ledgerId = request.entries.front().ledgerId;
+        request.entryId = request.entries.front().entryId;
+        break;
+    }
     case BookieOperation::Auth:
         break;
+
+    default:
+        // The client would wait forever for a response
+        LOG_WARN("Unsupported request operation: " << request.opCode);
+        return false;
     }
 
-    LOG_DEBUG("Deserialized request: " << request);
-    ctx->fireRead(std::move(request));
+    return true;
 }
 
-Future<Unit> BookieServerCodecV2::write(Context* ctx, Response response) {
-    LOG_DEBUG("Serializing response: " << response);
+int BookieResponseEncoder::frameSize(const Response& response, int& headerSize) {
+    // Packet header, error code, ledgerId and entryId
+    headerSize = 4 + 4 + 2 * sizeof(int64_t);
+    int dataSize = response.data ? response.data->computeChainDataLength() : 0;
 
-    const int headerSize = 4 + 24;
-    const int frameSize = headerSize /* + sizeof(data) */;
-    const int bufferSize = frameSize + 4;
-    IOBufPtr buf = IOBuf::create(bufferSize);
-    buf->append(bufferSize);
+    if (response.opCode == BookieOperation::BatchReadEntry) {
+        // Number of entries and size of each entry
+        headerSize += sizeof(int32_t) * (1 + response.entries.size());
+        for (const IOBufPtr& entry : response.entries) {
+            dataSize += entry->computeChainDataLength();
+        }
+    } else if (response.opCode == BookieOperation::MultiAddEntry) {
+        // Number of entries and error code of each entry
+        headerSize += sizeof(int32_t) + response.errorCodes.size();
+    }
 
-    PacketHeader pktHeader { response.protocolVersion, response.opCode, 0 };
-    io::RWPrivateCursor writer(buf.get());
+    return headerSize + dataSize;
+}
 
-    writer.writeBE<int32_t>(frameSize);
-    writer.writeBE<int32_t>(pktHeader.toInt());
+IOBufPtr BookieResponseEncoder::takePayload(Response& response) {
+    IOBufPtr payload = std::move(response.data);
 
-    switch (response.opCode) {
-    case BookieOperation::AddEntry:
-        writer.writeBE<int32_t>((int32_t) response.errorCode);
-        writer.writeBE<int64_t>(response.ledgerId);
-        writer.writeBE<int64_t>(response.entryId);
-        break;
+    for (IOBufPtr& entry : response.entries) {
+        if (payload) {
+            payload->prependChain(std::move(entry));
+        } else {
+            payload = std::move(entry);
+        }
+    }
 
-    case BookieOperation::ReadEntry:
-        writer.writeBE<int32_t>((int32_t) response.errorCode);
-        writer.writeBE<int64_t>(response.ledgerId);
-        writer.writeBE<int64_t>(response.entryId);
+    return payload;
+}
 
-        if (response.data) {
-            // Also write data
-//            buf->
-        }
+BookieServerCodecV2::BookieServerCodecV2(std::shared_ptr<WriteCoalescingHandler> writeCoalescer) :
+        writeCoalescer_(writeCoalescer) {
+}
 
-        break;
+Future<Unit> BookieServerCodecV2::write(Context* ctx, Response response) {
+    LOG_DEBUG("Serializing response: " << response);
 
-    case BookieOperation::Auth:
-        break;
+    int headerSize;
+    const int frameSize = BookieResponseEncoder::frameSize(response, headerSize);
+
+    if (writeCoalescer_) {
+        // The header goes straight into the pending writes of the connection, without allocating a buffer for it
+        writeCoalescer_->writeFrame([&](io::QueueAppender& writer) {
+            BookieResponseEncoder::writeHeader(writer, response, frameSize);
+        }, BookieResponseEncoder::takePayload(response));
+        return makeFuture();
+    }
+
+    const int bufferSize = headerSize + 4;
+    IOBufPtr buf = IOBuf::create(bufferSize);
+    buf->append(bufferSize);
+
+    io::RWPrivateCursor writer(buf.get());
+    BookieResponseEncoder::writeHeader(writer, response, frameSize);
+
+    IOBufPtr payload = BookieResponseEncoder::takePayload(response);
+    if (payload) {
+        buf->prependChain(std::move(payload));
     }
 
     return ctx->fireWrite(std::move(buf));
@@ -170,11 +272,44 @@ void BookieClientCodecV2::read(Context* ctx, IOBufPtr buf) {
         response.entryId = reader.readBE<int64_t>();
         break;
 
-    case BookieOperation::ReadEntry: {
+    case BookieOperation::MultiAddEntry: {
         response.errorCode = (BookieError) reader.readBE<int32_t>();
         response.ledgerId = reader.readBE<int64_t>();
         response.entryId = reader.readBE<int64_t>();
-        // TODO
+
+        response.errorCodes.resize(reader.readBE<int32_t>());
+        for (BookieError& errorCode : response.errorCodes) {
+            errorCode = (BookieError) reader.read<int8_t>();
+        }
+        break;
+    }
+    case BookieOperation::ReadEntry:
+    case BookieOperation::LongPollReadLastEntry: {
+        response.errorCode = (BookieError) reader.readBE<int32_t>();
+        response.ledgerId = reader.readBE<int64_t>();
+        response.entryId = reader.readBE<int64_t>();
+
+        if (response.errorCode == BookieError::OK) {
+            reader.clone(response.data, reader.totalLength());
+        }
+        break;
+    }
+    case BookieOperation::BatchReadEntry: {
+        response.errorCode = (BookieError) reader.readBE<int32_t>();
+        response.ledgerId = reader.readBE<int64_t>();
+        response.entryId = reader.readBE<int64_t>();
+
+        if (response.errorCode == BookieError::OK) {
+            std::vector<int32_t> sizes(reader.readBE<int32_t>());
+            for (int32_t& size : sizes) {
+                size = reader.readBE<int32_t>();
+            }
+
+            for (int32_t size : sizes) {
+                response.entries.emplace_back();
+                reader.clone(response.entries.back(), size);
+            }
+        }
         break;
     }
     case BookieOperation::Auth:
@@ -189,14 +324,44 @@ void BookieClientCodecV2::read(Context* ctx, IOBufPtr buf) {
 Future<Unit> BookieClientCodecV2::write(Context* ctx, Request request) {
     LOG_DEBUG("Serializing request: " << request);
 
-    constexpr int headerSize = sizeof(int32_t) + BookieConstant::MasterKeyLength + 2 * sizeof(int64_t);
-    const int frameSize = headerSize + request.data->length();
+    PacketHeader pktHeader { request.protocolVersion, request.opCode, request.flags };
+
+    if (request.opCode == BookieOperation::AddEntry && !request.data->isSharedOne()
+            && request.data->headroom() >= AddEntryHeaderSize) {
+        // Write the header in the payload headroom, to not allocate a buffer for it
+        const int frameSize = AddEntryHeaderSize - sizeof(int32_t) + request.data->length();
+        IOBufPtr buffer = std::move(request.data);
+        buffer->prepend(AddEntryHeaderSize);
+
+        io::RWPrivateCursor writer(buffer.get());
+        writer.writeBE<int32_t>(frameSize);
+        writer.writeBE<int32_t>(pktHeader.toInt());
+        writer.skip(BookieConstant::MasterKeyLength);
+        writer.writeBE<int64_t>(request.ledgerId);
+        writer.writeBE<int64_t>(request.entryId);
+        return ctx->fireWrite(std::move(buffer));
+    }
+
+    // Batch and long-poll reads have their parameters instead of the master key
+    int headerSize = sizeof(int32_t) + BookieConstant::MasterKeyLength + 2 * sizeof(int64_t);
+    if (request.opCode == BookieOperation::BatchReadEntry) {
+        headerSize = sizeof(int32_t) + 2 * sizeof(int64_t) + 2 * sizeof(int32_t);
+    } else if (request.opCode == BookieOperation::LongPollReadLastEntry) {
+        headerSize = sizeof(int32_t) + 2 * sizeof(int64_t) + sizeof(int32_t);
+    } else if (request.opCode == BookieOperation::MultiAddEntry) {
+        // The entries are copied after the header
+        headerSize = sizeof(int32_t) + sizeof(int32_t);
+        for (const EntryPayload& entry : request.entries) {
+            headerSize += 2 * sizeof(int64_t) + sizeof(int32_t) + entry.data->computeChainDataLength();
+        }
+    }
+
+    const int frameSize = headerSize + (request.data ? request.data->length() : 0);
     const int bufferSize = headerSize + 4;
 
     IOBufPtr buffer = IOBuf::create(bufferSize);
     buffer->append(bufferSize);
 
-    PacketHeader pktHeader { request.protocolVersion, request.opCode, request.flags };
     io::RWPrivateCursor writer(buffer.get());
 
     writer.writeBE<int32_t>(frameSize);
@@ -214,6 +379,31 @@ Future<Unit> BookieClientCodecV2::write(Context* ctx, Request request) {
         // TODO
         break;
 
+    case BookieOperation::BatchReadEntry:
+        writer.writeBE<int64_t>(request.ledgerId);
+        writer.writeBE<int64_t>(request.entryId);
+        writer.writeBE<int32_t>(request.maxCount);
+        writer.writeBE<int32_t>(request.maxBytes);
+        break;
+
+    case BookieOperation::LongPollReadLastEntry:
+        writer.writeBE<int64_t>(request.ledgerId);
+        writer.writeBE<int64_t>(request.entryId);
+        writer.writeBE<int32_t>(request.timeoutMillis);
+        break;
+
+    case BookieOperation::MultiAddEntry:
+        writer.writeBE<int32_t>(request.entries.size());
+        for (const EntryPayload& entry : request.entries) {
+            writer.writeBE<int64_t>(entry.ledgerId);
+            writer.writeBE<int64_t>(entry.entryId);
+            writer.writeBE<int32_t>(entry.data->computeChainDataLength());
+            for (ByteRange range : *entry.data) {
+                writer.push(range);
+            }
+        }
+        break;
+
     case BookieOperation::Auth:
         // TODO
         break;
@@ -20,21 +20,146 @@
  */
 #pragma once
 
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
 #include <wangle/channel/Handler.h>
 
 #include "BookieProtocol.h"
+#include "PayloadArena.h"
+#include "WriteCoalescingHandler.h"
 
 using namespace wangle;
 using namespace folly;
 
+struct PacketHeader {
+    int8_t version;
+    BookieOperation opCode;
+    int16_t flags;
+
+    static PacketHeader fromInt(int value) {
+        PacketHeader hdr;
+        hdr.version = value >> 24;
+        hdr.opCode = (BookieOperation) ((value >> 16) & 0xFF);
+        hdr.flags = value & 0xFF;
+        return hdr;
+    }
+
+    int toInt() const {
+        return ((version & 0xFF) << 24) | (((int8_t) opCode & 0xFF) << 16) | ((int16_t) flags & 0xFFFF);
+    }
+};
+
 /**
- * Codec for BookKeeper V2 wire format
+ * Decodes the request frames of the V2 wire format, for the transports feeding the bookie handler
  */
-class BookieServerCodecV2: public Handler<IOBufPtr, Request, Response, IOBufPtr> {
+class BookieRequestDecoder {
 public:
-    void read(Context* ctx, IOBufPtr buf) override;
+    /**
+     * @param shareLargePayloads false if the frames are overwritten once decoded, see PayloadArena
+     */
+    explicit BookieRequestDecoder(bool shareLargePayloads = true);
+
+    /**
+     * Decode a frame, after its length field. The cursor can see past the end of the frame.
+     *
+     * @return false if the frame is malformed or its operation is not supported
+     */
+    bool decode(io::Cursor& reader, size_t frameSize, Request& request);
+
+private:
+    PayloadArena payloadArena_;
+};
+
+/**
+ * Serializes the response frames of the V2 wire format, for the transports feeding the bookie handler
+ */
+class BookieResponseEncoder {
+public:
+    /**
+     * @return the size of the response frame, after its length field. The header size excludes the payloads.
+     */
+    static int frameSize(const Response& response, int& headerSize);
+
+    /**
+     * Serialize the length field and the header of a response frame, everything but the payloads
+     */
+    template<typename Writer>
+    static void writeHeader(Writer& writer, const Response& response, int frameSize);
+
+    /**
+     * Chain the payloads of a response, to send them after the header without copying them
+     */
+    static IOBufPtr takePayload(Response& response);
+};
+
+template<typename Writer>
+void BookieResponseEncoder::writeHeader(Writer& writer, const Response& response, int frameSize) {
+    PacketHeader pktHeader { response.protocolVersion, response.opCode, 0 };
+
+    writer.template writeBE<int32_t>(frameSize);
+    writer.template writeBE<int32_t>(pktHeader.toInt());
+
+    switch (response.opCode) {
+    case BookieOperation::AddEntry:
+    case BookieOperation::ReadEntry:
+    case BookieOperation::LongPollReadLastEntry:
+        writer.template writeBE<int32_t>((int32_t) response.errorCode);
+        writer.template writeBE<int64_t>(response.ledgerId);
+        writer.template writeBE<int64_t>(response.entryId);
+        break;
+
+    case BookieOperation::MultiAddEntry:
+        writer.template writeBE<int32_t>((int32_t) response.errorCode);
+        writer.template writeBE<int64_t>(response.ledgerId);
+        writer.template writeBE<int64_t>(response.entryId);
+        writer.template writeBE<int32_t>(response.errorCodes.size());
+
+        for (BookieError errorCode : response.errorCodes) {
+            writer.template write<int8_t>((int8_t) errorCode);
+        }
+        break;
+
+    case BookieOperation::BatchReadEntry:
+        writer.template writeBE<int32_t>((int32_t) response.errorCode);
+        writer.template writeBE<int64_t>(response.ledgerId);
+        writer.template writeBE<int64_t>(response.entryId);
+        writer.template writeBE<int32_t>(response.entries.size());
+
+        // The entries follow the sizes table
+        for (const IOBufPtr& entry : response.entries) {
+            writer.template writeBE<int32_t>(entry->computeChainDataLength());
+        }
+        break;
+
+    case BookieOperation::Auth:
+        break;
+    }
+}
+
+/**
+ * Codec for BookKeeper V2 wire format.
+ *
+ * The requests are framed and decoded in a single pass over the socket read buffers, without splitting each frame
+ * in its own buffer first, and all the complete frames of a read are decoded at once.
+ *
+ * The small add payloads are copied out of the frame buffers into an arena, to not keep the socket read buffers
+ * alive while the entries are queued or cached.
+ *
+ * When given the write coalescing handler of the pipeline, the responses are serialized directly into its pending
+ * writes, so that framing a response doesn't allocate any buffer. The coalescing handler must then be the next
+ * outbound handler of the pipeline.
+ */
+class BookieServerCodecV2: public Handler<IOBufQueue&, Request, Response, IOBufPtr> {
+public:
+    explicit BookieServerCodecV2(std::shared_ptr<WriteCoalescingHandler> writeCoalescer = nullptr);
+
+    void read(Context* ctx, IOBufQueue& queue) override;
 
     Future<Unit> write(Context* ctx, Response response) override;
+
+private:
+    BookieRequestDecoder decoder_;
+    std::shared_ptr<WriteCoalescingHandler> writeCoalescer_;
 };
 
 /**
@@ -42,6 +167,13 @@ public:
  */
 class BookieClientCodecV2: public Handler<IOBufPtr, Response, Request, IOBufPtr> {
 public:
+    /**
+     * Size of the length field and of the header of an add request. Payloads with this much headroom get the header
+     * written in place, instead of in a separate buffer.
+     */
+    static constexpr size_t AddEntryHeaderSize = 2 * sizeof(int32_t) + BookieConstant::MasterKeyLength
+            + 2 * sizeof(int64_t);
+
     void read(Context* ctx, IOBufPtr buf) override;
 
     Future<Unit> write(Context* ctx, Request response) override;
@@ -19,7 +19,10 @@
  *
  */
 #include "BookieConfig.h"
+#include "BookieProtocol.h"
+#include "CpuAffinity.h"
 #include <iostream>
+#include <limits>
 
 #include <unistd.h>
 
@@ -27,8 +30,38 @@ BookieConfig::BookieConfig() :
         zkServers_(),
         zkSessionTimeout_(0),
         bookiePort_(),
+        numIoThreads_(0),
+        reusePortAcceptors_(false),
+        numReadThreads_(0),
+        ioThreadsCpus_(),
+        journalThreadsCpus_(),
+        storageThreadsCpus_(),
+        numaNode_(-1),
+        numShards_(0),
+        shardThreadsCpus_(),
+        localTransportPath_(),
+        localTransportRingSize_(0),
         dataDirectory_(),
         walDirectory_(),
+        fsyncWal_(true),
+        numJournals_(1),
+        journalMaxBatchBytes_(0),
+        journalMaxGroupDelayMicros_(0),
+        journalTargetSyncLatencyMicros_(0),
+        journalFlushWhenQueueEmpty_(true),
+        journalIoEngine_(),
+        journalIoDepth_(0),
+        journalMaxFileSize_(0),
+        journalDirectIo_(false),
+        entryLogMaxSize_(0),
+        writeCacheMaxSize_(0),
+        readAheadCacheMaxSize_(0),
+        readAheadMaxEntries_(0),
+        maxPendingAddEntries_(0),
+        maxPendingAddBytes_(0),
+        rejectAddsWhenOverloaded_(false),
+        memoryLimit_(0),
+        checkpointIntervalSeconds_(0),
         options_("Allowed options", 100) {
 
     char defaultHostname[256];
@@ -42,10 +75,72 @@ BookieConfig::BookieConfig() :
     ("zkSessionTimeout", po::value<int>(&zkSessionTimeout_)->default_value(30000), "ZooKeeper session timeout") //
     ("bookieHost", po::value<std::string>(&bookieHost_)->default_value(defaultHostname), "Boookie hostname") //
     ("bookiePort,p", po::value<int>(&bookiePort_)->default_value(3181), "Bookie TCP port") //
+    ("numIoThreads", po::value<int>(&numIoThreads_)->default_value(0),
+            "Number of threads serving the connections. 0 to have one per core") //
+    ("reusePortAcceptors", po::value<bool>(&reusePortAcceptors_)->default_value(false),
+            "Accept the connections on one SO_REUSEPORT socket per IO thread, instead of a single acceptor thread") //
+    ("numReadThreads", po::value<int>(&numReadThreads_)->default_value(8),
+            "Number of threads reading the entries from the storage, when not in partitioned mode") //
+    ("ioThreadsCpus", po::value<std::string>(&ioThreadsCpus_)->default_value(""),
+            "CPUs the IO threads are pinned to, one CPU per thread, eg. '0-7,16-23'. Empty to not pin them") //
+    ("journalThreadsCpus", po::value<std::string>(&journalThreadsCpus_)->default_value(""),
+            "CPUs the journal threads are pinned to. Empty to not pin them") //
+    ("storageThreadsCpus", po::value<std::string>(&storageThreadsCpus_)->default_value(""),
+            "CPUs the RocksDB background threads, the checkpoint thread and the read threads are pinned to. Empty "
+                    "to not pin them") //
+    ("numaNode", po::value<int>(&numaNode_)->default_value(-1),
+            "On machines with several NUMA nodes, pin the threads without explicit CPUs to the CPUs of this node") //
+    ("numShards", po::value<int>(&numShards_)->default_value(0),
+            "Partitioned mode: number of storage shards, each owning a partition of the ledgers with its own "
+                    "thread, journals, entry logs and index. 0 to have a single storage shared by all the threads") //
+    ("shardThreadsCpus", po::value<std::string>(&shardThreadsCpus_)->default_value(""),
+            "CPUs the storage shard threads are pinned to, one CPU per thread. Empty to not pin them") //
+    ("localTransportPath", po::value<std::string>(&localTransportPath_)->default_value(""),
+            "Unix socket path for the clients on the same host, which then exchange the entries through shared "
+                    "memory rings. Empty to disable the local transport") //
+    ("localTransportRingSize", po::value<size_t>(&localTransportRingSize_)->default_value(16 * 1024 * 1024),
+            "Size of each of the request and response rings of a local client") //
     ("dataDir,d", po::value<std::string>(&dataDirectory_)->default_value("./data"), "Location where to store data") //
     ("walDir,w", po::value<std::string>(&walDirectory_)->default_value("./wal"),
-            "Location where to put RocksDB Write-ahead-log") //
+            "Location where to put the journal files") //
     ("fsyncWal,s", po::value<bool>(&fsyncWal_)->default_value(true), "Fsync the WAL before acking the entry") //
+    ("numJournals,j", po::value<int>(&numJournals_)->default_value(1),
+            "Number of journal threads. Entries are assigned to a journal based on their ledger id") //
+    ("journalMaxBatchBytes", po::value<size_t>(&journalMaxBatchBytes_)->default_value(4 * 1024 * 1024),
+            "Max size in bytes of a journal group commit") //
+    ("journalMaxGroupDelayMicros", po::value<int>(&journalMaxGroupDelayMicros_)->default_value(2000),
+            "Max time an entry can wait for its journal group commit to start") //
+    ("journalTargetSyncLatencyMicros", po::value<int>(&journalTargetSyncLatencyMicros_)->default_value(2000),
+            "Target journal sync latency. The journal batch size is reduced when syncs are slower than this") //
+    ("journalFlushWhenQueueEmpty", po::value<bool>(&journalFlushWhenQueueEmpty_)->default_value(true),
+            "Commit the journal batch as soon as the queue is drained, without waiting for more entries") //
+    ("journalIoEngine", po::value<std::string>(&journalIoEngine_)->default_value("sync"),
+            "Engine used for the journal writes and syncs: 'sync' or 'io_uring'") //
+    ("journalIoDepth", po::value<int>(&journalIoDepth_)->default_value(8),
+            "Max number of journal batches being written at the same time, with the io_uring engine") //
+    ("journalMaxFileSize", po::value<size_t>(&journalMaxFileSize_)->default_value(1024 * 1024 * 1024),
+            "Size after which a new journal file is started") //
+    ("journalDirectIo", po::value<bool>(&journalDirectIo_)->default_value(false),
+            "Write the journal with O_DIRECT into preallocated files, which are reused once checkpointed") //
+    ("entryLogMaxSize", po::value<size_t>(&entryLogMaxSize_)->default_value(1024 * 1024 * 1024),
+            "Size after which a new entry log file is started") //
+    ("writeCacheMaxSize", po::value<size_t>(&writeCacheMaxSize_)->default_value(256 * 1024 * 1024),
+            "Memory used to cache the recently added entries for the tailing reads. 0 disables the cache") //
+    ("readAheadCacheMaxSize", po::value<size_t>(&readAheadCacheMaxSize_)->default_value(256 * 1024 * 1024),
+            "Memory used for the entries prefetched for the sequential reads. 0 disables the read-ahead") //
+    ("readAheadMaxEntries", po::value<int>(&readAheadMaxEntries_)->default_value(1024),
+            "Max number of entries prefetched ahead of a sequential reader") //
+    ("maxPendingAddEntries", po::value<size_t>(&maxPendingAddEntries_)->default_value(10000),
+            "Max number of entries being added, after which the bookie stops accepting new entries") //
+    ("maxPendingAddBytes", po::value<size_t>(&maxPendingAddBytes_)->default_value(256 * 1024 * 1024),
+            "Max size in bytes of the entries being added, after which the bookie stops accepting new entries") //
+    ("rejectAddsWhenOverloaded", po::value<bool>(&rejectAddsWhenOverloaded_)->default_value(false),
+            "Reject the adds with TooManyRequests when overloaded, instead of pausing the reads from the connection. "
+                    "Always done by the storage shards in partitioned mode") //
+    ("memoryLimit", po::value<size_t>(&memoryLimit_)->default_value(1024 * 1024 * 1024),
+            "Max memory used by the entries being added and by the caches. The caches are shrunk when getting close") //
+    ("checkpointIntervalSeconds", po::value<int>(&checkpointIntervalSeconds_)->default_value(60),
+            "Interval for syncing the entry logs and the index, after which the journal files can be deleted") //
 
     ("statsReportingIntervalSeconds,r", po::value<int>(&statsReportingIntervalSeconds_)->default_value(60),
             "Interval for stats reporting") //
@@ -64,6 +159,48 @@ bool BookieConfig::parse(int argc, char** argv) {
             exit(1);
         }
 
+        if (numJournals_ < 1) {
+            throw std::invalid_argument("numJournals must be at least 1");
+        }
+
+        if (numIoThreads_ < 0) {
+            throw std::invalid_argument("numIoThreads can't be negative");
+        }
+
+        if (numReadThreads_ < 1) {
+            throw std::invalid_argument("numReadThreads must be at least 1");
+        }
+
+        if (numShards_ < 0) {
+            throw std::invalid_argument("numShards can't be negative");
+        }
+
+        if (journalIoEngine_ != "sync" && journalIoEngine_ != "io_uring") {
+            throw std::invalid_argument("journalIoEngine must be 'sync' or 'io_uring'");
+        }
+
+        if (journalIoDepth_ < 1) {
+            throw std::invalid_argument("journalIoDepth must be at least 1");
+        }
+
+        if (journalMaxBatchBytes_ == 0 || journalMaxBatchBytes_ > std::numeric_limits<int32_t>::max()) {
+            throw std::invalid_argument("journalMaxBatchBytes must be positive and less than 2GB");
+        }
+
+        if (!localTransportPath_.empty() && localTransportRingSize_ < 2 * BookieConstant::MaxFrameSize) {
+            throw std::invalid_argument("localTransportRingSize must be at least twice the max frame size");
+        }
+
+        // Validate the CPU lists and the NUMA node upfront
+        CpuAffinity::threadCpus(ioThreadsCpus_, numaNode_);
+        CpuAffinity::threadCpus(journalThreadsCpus_, numaNode_);
+        CpuAffinity::threadCpus(storageThreadsCpus_, numaNode_);
+        CpuAffinity::threadCpus(shardThreadsCpus_, numaNode_);
+
+        if (journalDirectIo_ && journalMaxFileSize_ < 2 * (journalMaxBatchBytes_ + BookieConstant::MaxFrameSize)) {
+            throw std::invalid_argument("journalMaxFileSize is too small to hold the journal batches");
+        }
+
         return true;
     }
     catch (const std::exception& e) {
@@ -50,6 +50,50 @@ public:
         return bookiePort_;
     }
 
+    int numIoThreads() const {
+        return numIoThreads_;
+    }
+
+    bool reusePortAcceptors() const {
+        return reusePortAcceptors_;
+    }
+
+    int numReadThreads() const {
+        return numReadThreads_;
+    }
+
+    const std::string& ioThreadsCpus() const {
+        return ioThreadsCpus_;
+    }
+
+    const std::string& journalThreadsCpus() const {
+        return journalThreadsCpus_;
+    }
+
+    const std::string& storageThreadsCpus() const {
+        return storageThreadsCpus_;
+    }
+
+    int numaNode() const {
+        return numaNode_;
+    }
+
+    int numShards() const {
+        return numShards_;
+    }
+
+    const std::string& shardThreadsCpus() const {
+        return shardThreadsCpus_;
+    }
+
+    const std::string& localTransportPath() const {
+        return localTransportPath_;
+    }
+
+    size_t localTransportRingSize() const {
+        return localTransportRingSize_;
+    }
+
     const std::string& dataDirectory() const {
         return dataDirectory_;
     }
@@ -62,6 +106,78 @@ public:
         return fsyncWal_;
     }
 
+    int numJournals() const {
+        return numJournals_;
+    }
+
+    size_t journalMaxBatchBytes() const {
+        return journalMaxBatchBytes_;
+    }
+
+    microseconds journalMaxGroupDelay() const {
+        return microseconds(journalMaxGroupDelayMicros_);
+    }
+
+    microseconds journalTargetSyncLatency() const {
+        return microseconds(journalTargetSyncLatencyMicros_);
+    }
+
+    bool journalFlushWhenQueueEmpty() const {
+        return journalFlushWhenQueueEmpty_;
+    }
+
+    const std::string& journalIoEngine() const {
+        return journalIoEngine_;
+    }
+
+    int journalIoDepth() const {
+        return journalIoDepth_;
+    }
+
+    size_t journalMaxFileSize() const {
+        return journalMaxFileSize_;
+    }
+
+    bool journalDirectIo() const {
+        return journalDirectIo_;
+    }
+
+    size_t entryLogMaxSize() const {
+        return entryLogMaxSize_;
+    }
+
+    size_t writeCacheMaxSize() const {
+        return writeCacheMaxSize_;
+    }
+
+    size_t readAheadCacheMaxSize() const {
+        return readAheadCacheMaxSize_;
+    }
+
+    int readAheadMaxEntries() const {
+        return readAheadMaxEntries_;
+    }
+
+    size_t maxPendingAddEntries() const {
+        return maxPendingAddEntries_;
+    }
+
+    size_t maxPendingAddBytes() const {
+        return maxPendingAddBytes_;
+    }
+
+    bool rejectAddsWhenOverloaded() const {
+        return rejectAddsWhenOverloaded_;
+    }
+
+    size_t memoryLimit() const {
+        return memoryLimit_;
+    }
+
+    seconds checkpointInterval() const {
+        return seconds(checkpointIntervalSeconds_);
+    }
+
     seconds statsReportingInterval() const {
         return seconds(statsReportingIntervalSeconds_);
     }
@@ -72,10 +188,42 @@ private:
 
     std::string bookieHost_;
     int bookiePort_;
+    int numIoThreads_;
+    bool reusePortAcceptors_;
+    int numReadThreads_;
+
+    std::string ioThreadsCpus_;
+    std::string journalThreadsCpus_;
+    std::string storageThreadsCpus_;
+    int numaNode_;
+
+    int numShards_;
+    std::string shardThreadsCpus_;
+
+    std::string localTransportPath_;
+    size_t localTransportRingSize_;
 
     std::string dataDirectory_;
     std::string walDirectory_;
     bool fsyncWal_;
+    int numJournals_;
+    size_t journalMaxBatchBytes_;
+    int journalMaxGroupDelayMicros_;
+    int journalTargetSyncLatencyMicros_;
+    bool journalFlushWhenQueueEmpty_;
+    std::string journalIoEngine_;
+    int journalIoDepth_;
+    size_t journalMaxFileSize_;
+    bool journalDirectIo_;
+    size_t entryLogMaxSize_;
+    size_t writeCacheMaxSize_;
+    size_t readAheadCacheMaxSize_;
+    int readAheadMaxEntries_;
+    size_t maxPendingAddEntries_;
+    size_t maxPendingAddBytes_;
+    bool rejectAddsWhenOverloaded_;
+    size_t memoryLimit_;
+    int checkpointIntervalSeconds_;
 
     int statsReportingIntervalSeconds_;
 
@@ -22,11 +22,27 @@
 #include "BookieHandler.h"
 #include "Bookie.h"
 
+#include <algorithm>
+
 DECLARE_LOG_OBJECT();
 
+static const int MaxBatchReadEntries = 10000;
+static const milliseconds MaxLongPollTimeout = seconds(60);
+
+// Interval at which a connection with paused reads checks whether the adds can be accepted again
+static const milliseconds ResumeReadingCheckInterval(1);
+
 BookieHandler::BookieHandler(Bookie& bookie, MetricsManager& metricsManager) :
         bookie_(bookie),
-        addEntryLatency_(metricsManager.createMetric("addEntry")) {
+        peerAddress_(),
+        pausedReadCallback_(nullptr),
+        addEntryLatency_(metricsManager.createMetric("addEntry")),
+        multiAddEntryLatency_(metricsManager.createMetric("multiAddEntry")),
+        readEntryLatency_(metricsManager.createMetric("readEntry")),
+        batchReadEntryLatency_(metricsManager.createMetric("batchReadEntry")),
+        batchReadEntryCount_(metricsManager.createValueMetric("batchReadEntryCount", MaxBatchReadEntries)),
+        longPollReadLatency_(metricsManager.createMetric("longPollReadLastEntry")),
+        pausedReadsDuration_(metricsManager.createMetric("pausedReadsDuration")) {
 }
 
 void BookieHandler::transportActive(Context* ctx) {
@@ -46,10 +62,22 @@ void BookieHandler::read(Context* ctx, Request request) {
         handleAddEntry(ctx, std::move(request));
         break;
 
+    case BookieOperation::MultiAddEntry:
+        handleMultiAddEntry(ctx, std::move(request));
+        break;
+
     case BookieOperation::ReadEntry:
         handleReadEntry(ctx, std::move(request));
         break;
 
+    case BookieOperation::BatchReadEntry:
+        handleBatchReadEntry(ctx, std::move(request));
+        break;
+
+    case BookieOperation::LongPollReadLastEntry:
+        handleLongPollReadLastEntry(ctx, std::move(request));
+        break;
+
     }
 }
 
@@ -60,23 +88,248 @@ void BookieHandler::handleAddEntry(Context* ctx, Request request) {
 
     Clock::time_point start = Clock::now();
 
-    Future<Unit> future = bookie_.addEntry(request.ledgerId, request.entryId, std::move(request.data)); //
-    future.then(ctx->getTransport()->getEventBase(), [=](Unit u) {
-        LOG_DEBUG("Entry persisted at " << ledgerId << ":" << entryId << " -- size: " << entryLength);
-        Response response {2, BookieOperation::AddEntry, BookieError::OK, ledgerId, entryId};
+    if (!admitAdd(ctx)) {
+        Response response {2, BookieOperation::AddEntry, BookieError::TooManyRequests, ledgerId, entryId};
+        write(ctx, std::move(response));
+        return;
+    }
+
+    // Acks are delivered to the event base in batches, together with the other entries of the same journal batch
+    bool queued = bookie_.addEntry(ledgerId, entryId, std::move(request.data), AddCompletion {
+        ctx->getTransport()->getEventBase(), [=](AddStatus status) {
+            if (status == AddStatus::Rejected) {
+                LOG_DEBUG("Journal queue is full, rejecting entry " << ledgerId << ":" << entryId);
+                Response response {2, BookieOperation::AddEntry, BookieError::TooManyRequests, ledgerId, entryId};
+
+                write(ctx, std::move(response));
+                return;
+            }
 
+            if (status == AddStatus::Failed) {
+                LOG_WARN("Failed to persist entry at " << ledgerId << ":" << entryId);
+                Response response {2, BookieOperation::AddEntry, BookieError::IOError, ledgerId, entryId};
+
+                write(ctx, std::move(response));
+                return;
+            }
+
+            LOG_DEBUG("Entry persisted at " << ledgerId << ":" << entryId << " -- size: " << entryLength);
+            Response response {2, BookieOperation::AddEntry, BookieError::OK, ledgerId, entryId};
+
+            write(ctx, std::move(response));
+
+            addEntryLatency_->addLatencySample(Clock::now() - start);
+        }
+    });
+
+    if (!queued) {
+        LOG_DEBUG("Journal queue is full, rejecting entry " << ledgerId << ":" << entryId);
+        Response response {2, BookieOperation::AddEntry, BookieError::TooManyRequests, ledgerId, entryId};
         write(ctx, std::move(response));
+    }
+}
+
+void BookieHandler::handleMultiAddEntry(Context* ctx, Request request) {
+    int64_t ledgerId = request.ledgerId;
+    int64_t entryId = request.entryId;
+    size_t count = request.entries.size();
 
-        addEntryLatency_->addLatencySample(Clock::now() - start);
+    Clock::time_point start = Clock::now();
+
+    if (!admitAdd(ctx)) {
+        Response response {2, BookieOperation::MultiAddEntry, BookieError::TooManyRequests, ledgerId, entryId};
+        response.errorCodes.assign(count, BookieError::TooManyRequests);
+        write(ctx, std::move(response));
+        return;
+    }
+
+    Future<std::vector<AddStatus>> future = bookie_.addEntries(std::move(request.entries));
+    future.then(ctx->getTransport()->getEventBase(), [=](const std::vector<AddStatus>& statuses) {
+        Response response {2, BookieOperation::MultiAddEntry, BookieError::OK, ledgerId, entryId};
+        response.errorCodes.reserve(count);
+
+        for (AddStatus status : statuses) {
+            BookieError errorCode = status == AddStatus::Persisted ? BookieError::OK
+                    : status == AddStatus::Rejected ? BookieError::TooManyRequests : BookieError::IOError;
+            response.errorCodes.push_back(errorCode);
+            if (errorCode != BookieError::OK) {
+                response.errorCode = errorCode;
+            }
+        }
+
+        LOG_DEBUG("Persisted " << count << " entries starting at " << ledgerId << ":" << entryId //
+                << " -- " << response.errorCode);
+        write(ctx, std::move(response));
+
+        multiAddEntryLatency_->addLatencySample(Clock::now() - start);
     }) //
     .onError([=](const std::exception& e) {
-        LOG_WARN("Failed to persist entry at " << ledgerId << ":" << entryId << " : " << e.what());
-        Response response {2, BookieOperation::AddEntry, BookieError::IOError, ledgerId, entryId};
+        LOG_WARN("Failed to persist " << count << " entries starting at " << ledgerId << ":" << entryId << " : " //
+                << e.what());
+        Response response {2, BookieOperation::MultiAddEntry, BookieError::IOError, ledgerId, entryId};
+        response.errorCodes.assign(count, BookieError::IOError);
 
         write(ctx, std::move(response));
     });
 }
 
 void BookieHandler::handleReadEntry(Context* ctx, Request request) {
+    int64_t ledgerId = request.ledgerId;
+    int64_t entryId = request.entryId;
+
+    Clock::time_point start = Clock::now();
+
+    // Reading the entry id -1 means reading the last entry of the ledger
+    bool readLastEntry = entryId == BookieConstant::InvalidEntryId;
+    Future<ReadResult> future = readLastEntry ? bookie_.getLastEntry(ledgerId) : bookie_.readEntry(ledgerId, entryId);
+
+    future.then(ctx->getTransport()->getEventBase(), [=](ReadResult result) {
+        LOG_DEBUG("Read entry " << ledgerId << ":" << entryId << " -- " << result.errorCode);
+        Response response {2, BookieOperation::ReadEntry, result.errorCode, ledgerId, entryId,
+            std::move(result.data)};
+
+        write(ctx, std::move(response));
+
+        readEntryLatency_->addLatencySample(Clock::now() - start);
+    }) //
+    .onError([=](const std::exception& e) {
+        LOG_WARN("Failed to read entry at " << ledgerId << ":" << entryId << " : " << e.what());
+        Response response {2, BookieOperation::ReadEntry, BookieError::IOError, ledgerId, entryId};
+
+        write(ctx, std::move(response));
+    });
+}
+
+void BookieHandler::handleBatchReadEntry(Context* ctx, Request request) {
+    int64_t ledgerId = request.ledgerId;
+    int64_t firstEntryId = request.entryId;
+
+    // The response must fit in a single frame, along with the size of each entry
+    int maxCount = std::max(1, std::min<int>(request.maxCount, MaxBatchReadEntries));
+    size_t maxBytes = std::max(0, std::min<int>(request.maxBytes,
+            BookieConstant::MaxFrameSize - 1024 - maxCount * sizeof(int32_t)));
+
+    Clock::time_point start = Clock::now();
+
+    Future<ReadResult> future = bookie_.readEntries(ledgerId, firstEntryId, maxCount, maxBytes);
+    future.then(ctx->getTransport()->getEventBase(), [=](ReadResult result) {
+        LOG_DEBUG("Read " << result.entries.size() << " entries from " << ledgerId << ":" << firstEntryId //
+                << " -- " << result.errorCode);
+        batchReadEntryCount_->addValueSample(result.entries.size());
+
+        Response response {2, BookieOperation::BatchReadEntry, result.errorCode, ledgerId, firstEntryId};
+        response.entries = std::move(result.entries);
+
+        write(ctx, std::move(response));
+
+        batchReadEntryLatency_->addLatencySample(Clock::now() - start);
+    }) //
+    .onError([=](const std::exception& e) {
+        LOG_WARN("Failed to read entries from " << ledgerId << ":" << firstEntryId << " : " << e.what());
+        Response response {2, BookieOperation::BatchReadEntry, BookieError::IOError, ledgerId, firstEntryId};
+
+        write(ctx, std::move(response));
+    });
+}
+
+void BookieHandler::handleLongPollReadLastEntry(Context* ctx, Request request) {
+    int64_t ledgerId = request.ledgerId;
+    int64_t previousEntryId = request.entryId;
+    milliseconds timeout = std::min(milliseconds(std::max(0, request.timeoutMillis)), MaxLongPollTimeout);
+
+    Clock::time_point start = Clock::now();
+
+    // The connection might be closed while the request is parked
+    std::weak_ptr<PipelineBase> pipeline = ctx->getPipelineShared();
+
+    EventBase* eventBase = ctx->getTransport()->getEventBase();
+    Future<bool> future = bookie_.waitForEntry(ledgerId, previousEntryId, timeout);
+    future.then(eventBase, [=](bool hasNewEntries) {
+        // The handler is gone along with the pipeline
+        if (!hasNewEntries || !pipeline.lock()) {
+            return makeFuture<ReadResult>(ReadResult { BookieError::NoEntry, nullptr, { } });
+        }
+
+        return bookie_.getLastEntry(ledgerId);
+    }) //
+    // In partitioned mode, the last entry is read on the shard thread
+    .via(eventBase) //
+    .then([=](ReadResult result) {
+        if (!pipeline.lock()) {
+            return;
+        }
+
+        IOBufPtr data = std::move(result.data);
+        BookieError errorCode = data ? BookieError::OK : BookieError::NoEntry;
+        LOG_DEBUG("Long-poll read of " << ledgerId << " after entry " << previousEntryId << " -- " << errorCode);
+        Response response {2, BookieOperation::LongPollReadLastEntry, errorCode, ledgerId, previousEntryId,
+            std::move(data)};
+
+        write(ctx, std::move(response));
+
+        longPollReadLatency_->addLatencySample(Clock::now() - start);
+    }) //
+    .onError([=](const std::exception& e) {
+        if (!pipeline.lock()) {
+            return;
+        }
+
+        LOG_WARN("Failed long-poll read of " << ledgerId << " after entry " << previousEntryId << " : " << e.what());
+        Response response {2, BookieOperation::LongPollReadLastEntry, BookieError::IOError, ledgerId,
+            previousEntryId};
+
+        write(ctx, std::move(response));
+    });
+}
+
+bool BookieHandler::admitAdd(Context* ctx) {
+    if (!bookie_.isOverloaded()) {
+        return true;
+    }
+
+    if (bookie_.rejectAddsWhenOverloaded()) {
+        return false;
+    }
+
+    // The requests already read are still accepted, the back-pressure is applied through the socket
+    pauseReading(ctx);
+    return true;
+}
+
+void BookieHandler::pauseReading(Context* ctx) {
+    if (pausedReadCallback_) {
+        return;
+    }
+
+    LOG_DEBUG("Bookie is overloaded, pausing reads from " << peerAddress_);
+    std::shared_ptr<AsyncTransportWrapper> transport = ctx->getTransport();
+    pausedReadCallback_ = transport->getReadCallback();
+    transport->setReadCB(nullptr);
+
+    scheduleResumeReading(ctx, Clock::now());
+}
+
+void BookieHandler::scheduleResumeReading(Context* ctx, Clock::time_point pauseStart) {
+    // The connection might be closed while the reads are paused
+    std::weak_ptr<PipelineBase> pipeline = ctx->getPipelineShared();
+
+    ctx->getTransport()->getEventBase()->runAfterDelay([=] {
+        if (!pipeline.lock()) {
+            return;
+        }
+
+        if (!bookie_.canResumeAdds()) {
+            scheduleResumeReading(ctx, pauseStart);
+            return;
+        }
+
+        std::shared_ptr<AsyncTransportWrapper> transport = ctx->getTransport();
+        if (transport->good()) {
+            LOG_DEBUG("Resuming reads from " << peerAddress_);
+            transport->setReadCB(pausedReadCallback_);
+        }
 
+        pausedReadCallback_ = nullptr;
+        pausedReadsDuration_->addLatencySample(Clock::now() - pauseStart);
+    }, ResumeReadingCheckInterval.count());
 }
@@ -43,10 +43,33 @@ public:
 
 private:
     void handleAddEntry(Context* ctx, Request request);
+    void handleMultiAddEntry(Context* ctx, Request request);
     void handleReadEntry(Context* ctx, Request request);
+    void handleBatchReadEntry(Context* ctx, Request request);
+    void handleLongPollReadLastEntry(Context* ctx, Request request);
+
+    /**
+     * Check whether a new add can be accepted. When the bookie is overloaded, either reject it or accept it and
+     * stop reading from the connection until the backlog has drained.
+     *
+     * @return false if the add must be rejected
+     */
+    bool admitAdd(Context* ctx);
+
+    void pauseReading(Context* ctx);
+    void scheduleResumeReading(Context* ctx, Clock::time_point pauseStart);
 
     Bookie& bookie_;
     SocketAddress peerAddress_;
 
+    // Set while the reads from the connection are paused
+    AsyncTransportWrapper::ReadCallback* pausedReadCallback_;
+
     MetricPtr addEntryLatency_;
+    MetricPtr multiAddEntryLatency_;
+    MetricPtr readEntryLatency_;
+    MetricPtr batchReadEntryLatency_;
+    MetricPtr batchReadEntryCount_;
+    MetricPtr longPollReadLatency_;
+    MetricPtr pausedReadsDuration_;
 };
@@ -23,7 +23,6 @@
 #include "Bookie.h"
 
 #include <wangle/channel/AsyncSocketHandler.h>
-#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
 #include <wangle/codec/LengthFieldPrepender.h>
 
 BookiePipelineFactory::BookiePipelineFactory(Bookie& bookie) :
@@ -33,8 +32,25 @@ BookiePipelineFactory::BookiePipelineFactory(Bookie& bookie) :
 BookiePipeline::Ptr BookiePipelineFactory::newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) {
     auto pipeline = BookiePipeline::create();
     pipeline->addBack(AsyncSocketHandler(sock));
-    pipeline->addBack(LengthFieldBasedFrameDecoder(4, BookieConstant::MaxFrameSize));
-    pipeline->addBack(BookieServerCodecV2());
+    // Responses produced in the same event loop iteration go out with a single write
+    auto writeCoalescer = bookie_.newWriteCoalescingHandler();
+    pipeline->addBack(writeCoalescer);
+    // The codec does the framing of the requests as well, and serializes the responses into the coalesced writes
+    pipeline->addBack(std::make_shared<BookieServerCodecV2>(writeCoalescer));
+    pipeline->addBack(bookie_.newHandler());
+    pipeline->finalize();
+    return pipeline;
+}
+
+BookieLocalPipelineFactory::BookieLocalPipelineFactory(Bookie& bookie) :
+        bookie_(bookie) {
+}
+
+BookiePipeline::Ptr BookieLocalPipelineFactory::newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) {
+    auto pipeline = BookiePipeline::create();
+    // The socket only carries the handshake and the doorbells
+    pipeline->addBack(AsyncSocketHandler(sock));
+    pipeline->addBack(bookie_.newLocalTransportHandler());
     pipeline->addBack(bookie_.newHandler());
     pipeline->finalize();
     return pipeline;
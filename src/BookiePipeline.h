@@ -43,3 +43,16 @@ public:
 private:
     Bookie& bookie_;
 };
+
+/**
+ * Define the processing pipeline of the local clients, whose requests and responses go through shared memory
+ */
+class BookieLocalPipelineFactory: public PipelineFactory<BookiePipeline> {
+public:
+    BookieLocalPipelineFactory(Bookie& bookie);
+
+    BookiePipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) override;
+
+private:
+    Bookie& bookie_;
+};
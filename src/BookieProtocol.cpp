@@ -35,6 +35,15 @@ std::ostream& operator<<(std::ostream& s, BookieOperation op) {
     case BookieOperation::Auth:
         s << "Auth";
         break;
+    case BookieOperation::BatchReadEntry:
+        s << "BatchReadEntry";
+        break;
+    case BookieOperation::LongPollReadLastEntry:
+        s << "LongPollReadLastEntry";
+        break;
+    case BookieOperation::MultiAddEntry:
+        s << "MultiAddEntry";
+        break;
     default:
         s << "Unknown bookie op (" << (int) op << ")";
         break;
@@ -88,6 +97,7 @@ std::ostream& operator<<(std::ostream& s, const Request& r) {
             << " entryId:" << r.entryId //
             << " flags:0x" << format("{0:04x}", r.flags) //
             << " data-len:" << (r.data ? r.data->length() : 0) //
+            << " entries:" << r.entries.size() //
             << ")";
 
     return s;
@@ -101,6 +111,7 @@ std::ostream& operator<<(std::ostream& s, const Response& r) {
             << " ledgerId:" << r.ledgerId //
             << " entryId:" << r.entryId //
             << " data-len:" << (r.data ? r.data->length() : 0) //
+            << " entries:" << r.entries.size() //
             << ")";
 
     return s;
@@ -23,6 +23,7 @@
 #include <folly/io/IOBuf.h>
 
 #include <iosfwd>
+#include <vector>
 
 using folly::IOBuf;
 
@@ -53,6 +54,37 @@ enum class BookieOperation
          * by the auth providers themselves.
          */
         Auth = 3,
+
+        /**
+         * Read a range of consecutive entries of a ledger in a single request. The request payload is the ledger
+         * number, the first entry number, the max number of entries (4-byte integer) and the max response size in
+         * bytes (4-byte integer).
+         *
+         * The response payload is a 4-byte error code, the ledger number, the first entry number, the number of
+         * entries returned (4-byte integer), the size of each entry (4-byte integers) and then the entries
+         * themselves, back to back. At least one entry is returned if the first one exists, even if it's bigger
+         * than the max response size.
+         */
+        BatchReadEntry = 7,
+
+        /**
+         * Long-poll read of the last entry of a ledger. The request payload is the ledger number, the last entry
+         * number known by the reader and a timeout in milliseconds (4-byte integer). The response is sent as soon as
+         * the ledger has a newer entry, with the same format as a ReadEntry response carrying the last entry. If
+         * the timeout expires first, the response has the NoEntry error code.
+         */
+        LongPollReadLastEntry = 8,
+
+        /**
+         * Add multiple entries in a single request. The request payload is the number of entries (4-byte integer)
+         * followed, for each entry, by the ledger number, the entry number, the entry size (4-byte integer) and the
+         * entry itself.
+         *
+         * The response payload is a 4-byte error code, OK if all the entries were added, the ledger number and the
+         * entry number of the first entry, the number of entries (4-byte integer) and then the 1-byte error code of
+         * each entry, in the request order.
+         */
+        MultiAddEntry = 9,
 };
 
 std::ostream& operator<<(std::ostream& s, BookieOperation op);
@@ -127,6 +159,15 @@ struct BookieConstant {
 
 typedef std::unique_ptr<IOBuf> IOBufPtr;
 
+/**
+ * An entry of a multi-add request
+ */
+struct EntryPayload {
+    int64_t ledgerId;
+    int64_t entryId;
+    IOBufPtr data;
+};
+
 struct Request {
     int8_t protocolVersion;
     BookieOperation opCode;
@@ -136,6 +177,16 @@ struct Request {
 
     IOBufPtr data;
 
+    // Limits of a batch read
+    int32_t maxCount;
+    int32_t maxBytes;
+
+    // Timeout of a long-poll read
+    int32_t timeoutMillis;
+
+    // Entries of a multi-add
+    std::vector<EntryPayload> entries;
+
     // Master key not supported
     // int8_t[] masterKey;
 
@@ -160,6 +211,12 @@ struct Response {
     int64_t entryId;
 
     IOBufPtr data;
+
+    // Entries of a batch read, starting at entryId
+    std::vector<IOBufPtr> entries;
+
+    // Result of each entry of a multi-add
+    std::vector<BookieError> errorCodes;
 };
 
 std::ostream& operator<<(std::ostream& s, const Response& response);
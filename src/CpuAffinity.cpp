@@ -0,0 +1,181 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "CpuAffinity.h"
+#include "Logging.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+DECLARE_LOG_OBJECT();
+
+std::vector<int> CpuAffinity::parseCpuList(const std::string& cpuList) {
+    std::vector<int> cpus;
+
+    std::vector<folly::StringPiece> ranges;
+    folly::split(',', folly::trimWhitespace(cpuList), ranges, true);
+
+    for (folly::StringPiece range : ranges) {
+        try {
+            folly::StringPiece first, last;
+            if (folly::split('-', range, first, last)) {
+                int lastCpu = folly::to<int>(last);
+                for (int cpu = folly::to<int>(first); cpu <= lastCpu; cpu++) {
+                    cpus.push_back(cpu);
+                }
+            } else {
+                cpus.push_back(folly::to<int>(range));
+            }
+        }
+        catch (const std::range_error&) {
+            throw std::invalid_argument(folly::to<std::string>("Invalid CPU list: '", cpuList, "'"));
+        }
+    }
+
+    return cpus;
+}
+
+std::map<int, std::vector<int>> CpuAffinity::numaNodes() {
+    std::map<int, std::vector<int>> nodes;
+    static const boost::regex nodeRegex("node([0-9]+)");
+
+    const fs::path nodesDirectory("/sys/devices/system/node");
+    if (fs::is_directory(nodesDirectory)) {
+        for (fs::directory_iterator it(nodesDirectory); it != fs::directory_iterator(); ++it) {
+            boost::smatch match;
+            std::string name = it->path().filename().string();
+            std::string cpuList;
+            if (boost::regex_match(name, match, nodeRegex)
+                    && folly::readFile((it->path() / "cpulist").string().c_str(), cpuList)) {
+                nodes[folly::to<int>(match[1].str())] = parseCpuList(cpuList);
+            }
+        }
+    }
+
+    if (nodes.empty()) {
+        std::vector<int>& cpus = nodes[0];
+        for (unsigned i = 0; i < std::thread::hardware_concurrency(); i++) {
+            cpus.push_back(i);
+        }
+    }
+
+    return nodes;
+}
+
+std::vector<int> CpuAffinity::threadCpus(const std::string& cpuList, int numaNode) {
+    std::vector<int> cpus = parseCpuList(cpuList);
+    if (!cpus.empty() || numaNode < 0) {
+        return cpus;
+    }
+
+    std::map<int, std::vector<int>> nodes = numaNodes();
+    if (nodes.size() == 1) {
+        // All the threads share the same memory node anyway
+        return cpus;
+    }
+
+    auto it = nodes.find(numaNode);
+    if (it == nodes.end()) {
+        throw std::invalid_argument(folly::to<std::string>("NUMA node ", numaNode, " does not exist"));
+    }
+
+    return it->second;
+}
+
+std::vector<int> CpuAffinity::currentThreadCpus() {
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpuSet)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    return cpus;
+}
+
+void CpuAffinity::pinCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return;
+    }
+
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpuSet);
+    }
+
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if (res != 0) {
+        LOG_WARN("Failed to set the thread CPU affinity: " << folly::errnoStr(res));
+    }
+#else
+    LOG_WARN("Thread CPU affinity is not supported on this platform");
+#endif
+}
+
+ScopedCpuAffinity::ScopedCpuAffinity(const std::vector<int>& cpus) :
+        previousCpus_() {
+    if (!cpus.empty()) {
+        previousCpus_ = CpuAffinity::currentThreadCpus();
+        CpuAffinity::pinCurrentThread(cpus);
+    }
+}
+
+ScopedCpuAffinity::~ScopedCpuAffinity() {
+    CpuAffinity::pinCurrentThread(previousCpus_);
+}
+
+PinnedThreadFactory::PinnedThreadFactory(const std::string& prefix, std::vector<int> cpus) :
+        namedThreadFactory_(prefix),
+        cpus_(std::move(cpus)),
+        nextThread_(0) {
+}
+
+std::thread PinnedThreadFactory::newThread(folly::Func&& func) {
+    if (cpus_.empty()) {
+        return namedThreadFactory_.newThread(std::move(func));
+    }
+
+    int cpu = cpus_[nextThread_++ % cpus_.size()];
+    return namedThreadFactory_.newThread([cpu, func = std::move(func)]() mutable {
+        CpuAffinity::pinCurrentThread( { cpu });
+        func();
+    });
+}
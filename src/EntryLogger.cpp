@@ -0,0 +1,202 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "EntryLogger.h"
+#include "Logging.h"
+
+#include <boost/filesystem.hpp>
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace folly;
+namespace fs = boost::filesystem;
+
+DECLARE_LOG_OBJECT();
+
+EntryLogger::EntryLogger(const std::string& directory, size_t maxLogSize) :
+        directory_(directory),
+        maxLogSize_(maxLogSize),
+        mutex_(),
+        currentLogId_(0),
+        currentLog_(),
+        currentLogSize_(0),
+        logsToFlush_(),
+        mappedLogsMutex_(),
+        mappedLogs_() {
+    fs::create_directories(directory_);
+
+    // Never write into existing entry logs, start after the last one
+    for (fs::directory_iterator it(directory_); it != fs::directory_iterator(); ++it) {
+        if (it->path().extension() == ".log") {
+            uint32_t logId = std::stoul(it->path().stem().string(), nullptr, 16);
+            currentLogId_ = std::max(currentLogId_, logId);
+        }
+    }
+
+    createNewLog();
+}
+
+void EntryLogger::addEntries(const std::vector<LogEntry>& entries, std::vector<EntryLocation>& locations) {
+    // Reused by each journal thread across batches, to not allocate it every time
+    static thread_local RecordBatch recordBatch;
+
+    uint32_t logId;
+    std::shared_ptr<File> log;
+    uint64_t offset;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (currentLogSize_ >= maxLogSize_) {
+            createNewLog();
+        }
+
+        logId = currentLogId_;
+        log = currentLog_;
+        recordBatch.reset(logId, entries);
+        offset = currentLogSize_;
+        currentLogSize_ += recordBatch.size();
+    }
+
+    // A failed write leaves a hole in the log, which is never referenced by the index
+    recordBatch.writeAt(log->fd(), offset);
+
+    for (const RecordHeader& header : recordBatch.headers()) {
+        locations.push_back(EntryLocation { logId, offset });
+        offset += sizeof(RecordHeader) + header.length;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (logId != currentLogId_) {
+        // The log was rotated while the batch was being written, it might have been flushed without the batch
+        logsToFlush_.push_back(std::move(log));
+    }
+}
+
+void EntryLogger::flush() {
+    std::vector<std::shared_ptr<File>> logs;
+
+    {
+        // Don't hold the lock while syncing, to not block the journals
+        std::lock_guard<std::mutex> lock(mutex_);
+        logs.swap(logsToFlush_);
+        logs.push_back(currentLog_);
+    }
+
+    for (size_t i = 0; i < logs.size(); i++) {
+        if (fdatasyncNoInt(logs[i]->fd()) != 0) {
+            // Keep the logs that weren't synced for the next flush
+            std::lock_guard<std::mutex> lock(mutex_);
+            logsToFlush_.insert(logsToFlush_.end(), logs.begin() + i, logs.end() - 1);
+            throwSystemError("Failed to sync entry log");
+        }
+    }
+}
+
+IOBufPtr EntryLogger::readEntry(int64_t ledgerId, int64_t entryId, EntryLocation location, bool willNeed) {
+    MappedLogPtr log = mappedLog(location.logId, location.offset + sizeof(RecordHeader));
+
+    RecordHeader header;
+    memcpy(&header, log->data + location.offset, sizeof(header));
+    uint64_t payloadOffset = location.offset + sizeof(RecordHeader);
+
+    if (!header.isValid(location.logId) || header.ledgerId != ledgerId || header.entryId != entryId) {
+        throw std::runtime_error(
+                sformat("Invalid record for entry {}:{} in entry log {} at offset {}", ledgerId, entryId,
+                        location.logId, location.offset));
+    }
+
+    if (payloadOffset + header.length > log->size) {
+        log = mappedLog(location.logId, payloadOffset + header.length);
+    }
+
+    // The buffer holds a reference to the mapping until it's released
+    void* data = (void*) (log->data + payloadOffset);
+
+    if (willNeed) {
+        uintptr_t pageStart = (uintptr_t) data & ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1);
+        madvise((void*) pageStart, (uintptr_t) data + header.length - pageStart, MADV_WILLNEED);
+    }
+
+    return IOBuf::takeOwnership(data, header.length, [](void*, void* userData) {
+        delete (MappedLogPtr*) userData;
+    }, new MappedLogPtr(std::move(log)));
+}
+
+EntryLogger::MappedLogPtr EntryLogger::mappedLog(uint32_t logId, uint64_t endOffset) {
+    std::lock_guard<std::mutex> lock(mappedLogsMutex_);
+
+    MappedLogPtr& log = mappedLogs_[logId];
+    if (!log || log->size < endOffset) {
+        // The current log keeps growing, map it up to the max log size to not have to remap it too often.
+        // Readers holding the previous mapping keep it alive.
+        log = std::make_shared<MappedLog>(path(logId), std::max<uint64_t>(endOffset, maxLogSize_));
+    }
+
+    return log;
+}
+
+EntryLogger::MappedLog::MappedLog(const std::string& path, size_t minSize) :
+        data(nullptr),
+        size(0) {
+    File file(path, O_RDONLY | O_CLOEXEC);
+
+    struct stat st;
+    checkUnixError(fstat(file.fd(), &st), "Failed to stat entry log ", path);
+
+    // Mapping past the end of the file is fine, as long as only the written part gets accessed
+    size = std::max<size_t>(st.st_size, minSize);
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, file.fd(), 0);
+    if (addr == MAP_FAILED) {
+        throwSystemError("Failed to map entry log ", path);
+    }
+
+    data = (const uint8_t*) addr;
+}
+
+EntryLogger::MappedLog::~MappedLog() {
+    munmap((void*) data, size);
+}
+
+void EntryLogger::createNewLog() {
+    if (currentLog_) {
+        // The previous log still needs to be synced by the next flush
+        logsToFlush_.push_back(std::move(currentLog_));
+    }
+
+    ++currentLogId_;
+    LOG_INFO("Creating entry log " << path(currentLogId_));
+    currentLog_ = std::make_shared<File>(path(currentLogId_), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    currentLogSize_ = 0;
+}
+
+std::string EntryLogger::path(uint32_t logId) const {
+    return sformat("{}/{:08x}.log", directory_, logId);
+}
@@ -0,0 +1,107 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LogRecord.h"
+
+using folly::File;
+
+struct EntryLocation {
+    uint32_t logId;
+    uint64_t offset;
+};
+
+/**
+ * Stores the entries payloads in entry log files, where the entries of all the ledgers are interleaved.
+ *
+ * Writes are not synced: the entries can be recovered from the journal until the entry log is flushed during a
+ * checkpoint. A new entry log is started once the current one reaches the max size.
+ *
+ * The journals only reserve the space for their batches under the lock, then write them concurrently at their
+ * offset.
+ *
+ * Entry logs are never garbage collected, since the ledgers can't be deleted.
+ *
+ * Entries are read through a read-only memory mapping of the entry logs, so that the payloads can be handed to
+ * the network layer without being copied.
+ */
+class EntryLogger {
+public:
+    EntryLogger(const std::string& directory, size_t maxLogSize);
+
+    /**
+     * Append the entries to the current entry log and return the location where each entry was written
+     */
+    void addEntries(const std::vector<LogEntry>& entries, std::vector<EntryLocation>& locations);
+
+    /**
+     * Sync all the entries added so far
+     */
+    void flush();
+
+    /**
+     * Read the entry at the given location. The returned buffer points into the mapped entry log and keeps the
+     * mapping alive.
+     *
+     * @param willNeed start reading the payload from the disk in the background, before it gets accessed
+     */
+    IOBufPtr readEntry(int64_t ledgerId, int64_t entryId, EntryLocation location, bool willNeed = false);
+
+private:
+    struct MappedLog {
+        const uint8_t* data;
+        size_t size;
+
+        MappedLog(const std::string& path, size_t minSize);
+        ~MappedLog();
+    };
+
+    typedef std::shared_ptr<MappedLog> MappedLogPtr;
+
+    MappedLogPtr mappedLog(uint32_t logId, uint64_t endOffset);
+
+    void createNewLog();
+
+    std::string path(uint32_t logId) const;
+
+    const std::string directory_;
+    const size_t maxLogSize_;
+
+    std::mutex mutex_;
+    uint32_t currentLogId_;
+    std::shared_ptr<File> currentLog_;
+    uint64_t currentLogSize_;
+
+    // Logs that were rotated since the last flush, or written after having been rotated
+    std::vector<std::shared_ptr<File>> logsToFlush_;
+
+    std::mutex mappedLogsMutex_;
+    std::map<uint32_t, MappedLogPtr> mappedLogs_;
+};
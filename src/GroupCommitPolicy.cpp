@@ -0,0 +1,54 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "GroupCommitPolicy.h"
+
+#include <algorithm>
+
+constexpr size_t GroupCommitPolicy::MinBatchEntries;
+constexpr size_t GroupCommitPolicy::MaxBatchEntries;
+constexpr int GroupCommitPolicy::SpinIterations;
+
+GroupCommitPolicy::GroupCommitPolicy(const BookieConfig& conf) :
+        maxBatchBytes_(conf.journalMaxBatchBytes()),
+        maxGroupDelay_(conf.journalMaxGroupDelay()),
+        targetSyncLatency_(conf.journalTargetSyncLatency()),
+        flushWhenQueueEmpty_(conf.journalFlushWhenQueueEmpty()),
+        maxBatchEntries_(MaxBatchEntries) {
+}
+
+bool GroupCommitPolicy::isBatchFull(size_t entries, size_t bytes, steady_clock::time_point batchStart) const {
+    return entries >= maxBatchEntries() || bytes >= maxBatchBytes_ || steady_clock::now() >= batchDeadline(batchStart);
+}
+
+void GroupCommitPolicy::onSyncCompleted(size_t entries, steady_clock::duration syncLatency) {
+    size_t maxBatchEntries = maxBatchEntries_.load(std::memory_order_relaxed);
+
+    if (syncLatency > targetSyncLatency_) {
+        // Only shrink when the batch size is likely to be the cause of the slow sync
+        if (entries * 2 >= maxBatchEntries) {
+            maxBatchEntries_.store(std::max(MinBatchEntries, maxBatchEntries / 2), std::memory_order_relaxed);
+        }
+    } else if (entries >= maxBatchEntries && syncLatency * 2 < targetSyncLatency_) {
+        // Batch was capped by the entries limit and there's still room before reaching the target latency
+        maxBatchEntries_.store(std::min(MaxBatchEntries, maxBatchEntries + maxBatchEntries / 4),
+                std::memory_order_relaxed);
+    }
+}
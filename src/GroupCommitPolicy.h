@@ -0,0 +1,84 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "BookieConfig.h"
+
+using namespace std::chrono;
+
+/**
+ * Decides when the journal should stop accumulating entries and commit the current batch.
+ *
+ * A batch is bounded by a number of entries, a number of bytes and by the time spent since the first entry was
+ * added. The max number of entries is adjusted after each sync, shrinking it when the sync takes longer than the
+ * target latency and growing it back when the syncs are fast and the batches are getting capped.
+ *
+ * The batch checks are done by the journal writer thread, while the syncs are reported by the journal sync thread.
+ */
+class GroupCommitPolicy {
+public:
+    explicit GroupCommitPolicy(const BookieConfig& conf);
+
+    bool isBatchFull(size_t entries, size_t bytes, steady_clock::time_point batchStart) const;
+
+    /**
+     * @return the deadline until when the journal can wait for more entries, before committing a non-empty batch
+     */
+    steady_clock::time_point batchDeadline(steady_clock::time_point batchStart) const {
+        return batchStart + maxGroupDelay_;
+    }
+
+    bool flushWhenQueueEmpty() const {
+        return flushWhenQueueEmpty_;
+    }
+
+    /**
+     * Number of times to poll the queue before parking the journal thread
+     */
+    int spinIterations() const {
+        return SpinIterations;
+    }
+
+    size_t maxBatchEntries() const {
+        return maxBatchEntries_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Report a completed sync, covering the given number of entries
+     */
+    void onSyncCompleted(size_t entries, steady_clock::duration syncLatency);
+
+private:
+    static constexpr size_t MinBatchEntries = 16;
+    static constexpr size_t MaxBatchEntries = 10000;
+    static constexpr int SpinIterations = 1000;
+
+    const size_t maxBatchBytes_;
+    const steady_clock::duration maxGroupDelay_;
+    const steady_clock::duration targetSyncLatency_;
+    const bool flushWhenQueueEmpty_;
+
+    std::atomic<size_t> maxBatchEntries_;
+};
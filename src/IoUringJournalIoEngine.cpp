@@ -0,0 +1,216 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "IoUringJournalIoEngine.h"
+#include "Logging.h"
+
+#include <folly/Exception.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <limits.h>
+
+DECLARE_LOG_OBJECT();
+
+// Max number of SQEs in the ring. A single batch needs one SQE for every IOV_MAX buffers, plus one for the sync.
+static const unsigned RingSize = 1024;
+
+IoUringJournalIoEngine::IoUringJournalIoEngine(bool fsync, int ioDepth) :
+        fsync_(fsync),
+        ioDepth_(std::max(1, ioDepth)),
+        ring_(),
+        mutex_(),
+        inFlightCondition_(),
+        inFlight_(),
+        closed_(false) {
+    int res = io_uring_queue_init(RingSize, &ring_, 0);
+    if (res < 0) {
+        throwSystemErrorExplicit(-res, "Failed to create io_uring");
+    }
+
+    LOG_INFO("Using io_uring journal engine with io depth " << ioDepth_);
+}
+
+IoUringJournalIoEngine::~IoUringJournalIoEngine() {
+    io_uring_queue_exit(&ring_);
+}
+
+void IoUringJournalIoEngine::submit(JournalWritePtr write) {
+    std::vector<iovec>& iovecs = write->records.iovecs();
+    size_t numWrites = (iovecs.size() + IOV_MAX - 1) / IOV_MAX;
+    unsigned numSqes = numWrites + (fsync_ ? 1 : 0);
+
+    if (numSqes > RingSize) {
+        write->error = "Journal batch has too many buffers";
+        numWrites = 0;
+        numSqes = 1;
+    }
+
+    write->submitTime = steady_clock::now();
+    int fd = write->file->fd();
+    uint64_t offset = write->offset;
+
+    std::unique_ptr<InFlightWrite> inFlightWrite(new InFlightWrite { std::move(write), (int) numSqes, 0 });
+    InFlightWrite* w = inFlightWrite.get();
+
+    {
+        // Limit the number of batches in flight
+        std::unique_lock<std::mutex> lock(mutex_);
+        inFlightCondition_.wait(lock, [this] {return inFlight_.size() < ioDepth_;});
+        inFlight_.push_back(std::move(inFlightWrite));
+    }
+
+    // The whole chain must be part of a single submission, otherwise the link would be broken
+    if (io_uring_sq_space_left(&ring_) < numSqes) {
+        io_uring_submit(&ring_);
+    }
+
+    if (!w->write->error.empty()) {
+        // Just report the failure, in order with the other writes
+        io_uring_sqe* sqe = getSqe();
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data(sqe, w);
+    } else {
+        for (size_t i = 0; i < numWrites; i++) {
+            size_t first = i * IOV_MAX;
+            unsigned count = std::min<size_t>(IOV_MAX, iovecs.size() - first);
+
+            io_uring_sqe* sqe = getSqe();
+            io_uring_prep_writev(sqe, fd, &iovecs[first], count, offset);
+            io_uring_sqe_set_data(sqe, w);
+
+            for (unsigned j = 0; j < count; j++) {
+                offset += iovecs[first + j].iov_len;
+            }
+
+            if (i + 1 < numSqes) {
+                sqe->flags |= IOSQE_IO_LINK;
+            }
+        }
+
+        if (fsync_) {
+            io_uring_sqe* sqe = getSqe();
+            io_uring_prep_fsync(sqe, fd, IORING_FSYNC_DATASYNC);
+            io_uring_sqe_set_data(sqe, w);
+        }
+    }
+
+    int res = io_uring_submit(&ring_);
+    if (res < 0) {
+        LOG_ERROR("Failed to submit journal write: " << strerror(-res));
+    }
+}
+
+void IoUringJournalIoEngine::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+
+    // Wake up the completion thread
+    io_uring_sqe* sqe = getSqe();
+    io_uring_prep_nop(sqe);
+    io_uring_sqe_set_data(sqe, nullptr);
+    io_uring_submit(&ring_);
+}
+
+io_uring_sqe* IoUringJournalIoEngine::getSqe() {
+    io_uring_sqe* sqe;
+    while ((sqe = io_uring_get_sqe(&ring_)) == nullptr) {
+        // Submission queue is full, make room by handing the pending SQEs over to the kernel
+        io_uring_submit(&ring_);
+    }
+
+    return sqe;
+}
+
+void IoUringJournalIoEngine::run(const CompletionCallback& callback) {
+    std::vector<JournalWritePtr> writes;
+
+    while (true) {
+        io_uring_cqe* cqe;
+        int res = io_uring_wait_cqe(&ring_, &cqe);
+        if (res == -EINTR) {
+            continue;
+        } else if (res < 0) {
+            LOG_FATAL("Failed to wait for journal completions: " << strerror(-res));
+            std::abort();
+        }
+
+        do {
+            handleCompletion(cqe);
+            io_uring_cqe_seen(&ring_, cqe);
+        } while (io_uring_peek_cqe(&ring_, &cqe) == 0);
+
+        steady_clock::time_point now = steady_clock::now();
+        steady_clock::duration syncLatency { 0 };
+        bool exiting;
+
+        {
+            // Report the completed writes, preserving the submission order
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!inFlight_.empty() && inFlight_.front()->pendingCompletions == 0) {
+                JournalWritePtr& write = inFlight_.front()->write;
+                syncLatency = std::max(syncLatency, now - write->submitTime);
+                writes.emplace_back(std::move(write));
+                inFlight_.pop_front();
+            }
+
+            exiting = closed_ && inFlight_.empty();
+        }
+
+        inFlightCondition_.notify_all();
+
+        if (!writes.empty()) {
+            callback(writes, syncLatency);
+            writes.clear();
+        }
+
+        if (exiting) {
+            return;
+        }
+    }
+}
+
+void IoUringJournalIoEngine::handleCompletion(io_uring_cqe* cqe) {
+    InFlightWrite* w = (InFlightWrite*) io_uring_cqe_get_data(cqe);
+    if (w == nullptr) {
+        // Wake-up from close()
+        return;
+    }
+
+    JournalWrite& write = *w->write;
+
+    if (cqe->res < 0) {
+        if (write.error.empty()) {
+            // Linked requests following a failed one are completed with -ECANCELED
+            write.error = std::string("Journal I/O failed: ") + strerror(-cqe->res);
+            LOG_ERROR("Failed to write journal file " << write.file->fileId() << ": " << write.error);
+        }
+    } else {
+        w->bytesWritten += cqe->res;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--w->pendingCompletions == 0 && write.error.empty() && w->bytesWritten != write.records.size()) {
+        write.error = "Short write on journal file";
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <liburing.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "JournalIoEngine.h"
+
+/**
+ * Journal engine based on io_uring.
+ *
+ * Each batch is submitted as a chain of linked SQEs: the writev() of the records followed by a fdatasync(), so
+ * that the journal thread never blocks on the disk and up to ioDepth batches can be in flight at the same time.
+ * The completions are reaped by the journal sync thread.
+ */
+class IoUringJournalIoEngine: public JournalIoEngine {
+public:
+    IoUringJournalIoEngine(bool fsync, int ioDepth);
+    ~IoUringJournalIoEngine();
+
+    void submit(JournalWritePtr write) override;
+
+    void close() override;
+
+    void run(const CompletionCallback& callback) override;
+
+private:
+    struct InFlightWrite {
+        JournalWritePtr write;
+        int pendingCompletions;
+        size_t bytesWritten;
+    };
+
+    io_uring_sqe* getSqe();
+
+    void handleCompletion(io_uring_cqe* cqe);
+
+    const bool fsync_;
+    const size_t ioDepth_;
+
+    io_uring ring_;
+
+    // Writes in submission order
+    std::mutex mutex_;
+    std::condition_variable inFlightCondition_;
+    std::deque<std::unique_ptr<InFlightWrite>> inFlight_;
+    bool closed_;
+};
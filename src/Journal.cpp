@@ -0,0 +1,579 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "BookieProtocol.h"
+#include "CpuAffinity.h"
+#include "Journal.h"
+#include "Logging.h"
+#include "Storage.h"
+
+#include <boost/filesystem.hpp>
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Portability.h>
+#include <folly/ThreadName.h>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+DECLARE_LOG_OBJECT();
+
+// Max number of checkpointed files kept around for reuse, per journal
+static const size_t MaxRecycledFiles = 4;
+
+Journal::Journal(int journalId, Storage& storage, const BookieConfig& conf, MetricsManager& metricsManager) :
+        journalId_(journalId),
+        directory_(to<std::string>(conf.walDirectory(), "/journal-", journalId)),
+        storage_(storage),
+        journalQueue_(10000),
+        maxFileSize_(conf.journalMaxFileSize()),
+        directIo_(conf.journalDirectIo()),
+        groupCommitPolicy_(conf),
+        bufferPool_(
+                directIo_ ?
+                        new AlignedBufferPool(conf.journalMaxBatchBytes() + BookieConstant::MaxFrameSize,
+                                conf.journalIoDepth() + 2) :
+                        nullptr),
+        ioEngine_(JournalIoEngine::create(conf.journalIoEngine(), conf.fsyncWal(), conf.journalIoDepth())),
+        currentFile_(),
+        nextFileId_(1),
+        rollFile_(false),
+        failedFileId_(0),
+        markMutex_(),
+        lastMark_(),
+        writePoolMutex_(),
+        writePool_(),
+        maxPooledWrites_(conf.journalIoDepth() + 2),
+        ackBatches_(),
+        recycledFilesMutex_(),
+        recycledFiles_(),
+        cpus_(CpuAffinity::threadCpus(conf.journalThreadsCpus(), conf.numaNode())),
+        addEntryEnqueueLatency_(metricsManager.createMetric(to<std::string>("addEntryEnqueueLatency-", journalId))),
+        walSyncLatency_(metricsManager.createMetric(to<std::string>("walSync-", journalId))),
+        walQueueLatency_(metricsManager.createMetric(to<std::string>("walQueueLatency-", journalId))),
+        walBatchSize_(metricsManager.createValueMetric(to<std::string>("walBatchSize-", journalId), 10000)),
+        walBatchBytes_(
+                metricsManager.createValueMetric(to<std::string>("walBatchBytes-", journalId),
+                        conf.journalMaxBatchBytes() + BookieConstant::MaxFrameSize)) {
+    fs::create_directories(directory_);
+    replay();
+
+    currentFile_ = createJournalFile();
+    lastMark_ = JournalMark { currentFile_->fileId(), 0 };
+
+    journalThread_ = std::thread(std::bind(&Journal::run, this));
+    syncThread_ = std::thread(std::bind(&Journal::runSync, this));
+}
+
+Journal::~Journal() {
+    // Write an entry without promise nor callback to make the journal thread to exit
+    JournalEntry entry { { }, { }, { }, nullptr, walQueueLatency_->startTimer() };
+    journalQueue_.blockingWrite(std::move(entry));
+    journalThread_.join();
+    syncThread_.join();
+}
+
+bool Journal::append(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion) {
+    uint32_t checksum = payloadChecksum(*data);
+    JournalEntry entry { LogEntry { ledgerId, entryId, std::move(data), checksum }, { }, std::move(completion),
+            nullptr, walQueueLatency_->startTimer() };
+
+    // Never block the IO threads when the queue is full
+    Timer addEntryEnqueueTimer = addEntryEnqueueLatency_->startTimer();
+    bool enqueued = journalQueue_.write(std::move(entry));
+    addEntryEnqueueTimer.completed();
+    return enqueued;
+}
+
+Future<Unit> Journal::appendBatch(std::vector<LogEntry> entries) {
+    PromisePtr promise = make_unique<Promise<Unit>>();
+    Future<Unit> future = promise->getFuture();
+
+    for (LogEntry& entry : entries) {
+        entry.checksum = payloadChecksum(*entry.data);
+    }
+
+    JournalEntry entry { { }, std::move(entries), { }, std::move(promise), walQueueLatency_->startTimer() };
+
+    Timer addEntryEnqueueTimer = addEntryEnqueueLatency_->startTimer();
+    bool enqueued = journalQueue_.write(std::move(entry));
+    addEntryEnqueueTimer.completed();
+
+    if (!enqueued) {
+        // The entry is left untouched when the queue is full
+        storage_.entriesFailed(entry.batch);
+        return makeFuture<Unit>(std::runtime_error("Journal queue is full"));
+    }
+
+    return future;
+}
+
+JournalMark Journal::lastMark() {
+    std::lock_guard<std::mutex> lock(markMutex_);
+    return lastMark_;
+}
+
+void Journal::checkpointCompleted(JournalMark mark) {
+    writeLastMark(mark);
+
+    for (uint32_t fileId : listJournalFiles()) {
+        if (fileId < mark.fileId) {
+            releaseFile(JournalFile::path(directory_, fileId));
+        }
+    }
+}
+
+void Journal::releaseFile(const std::string& path) {
+    if (directIo_) {
+        std::lock_guard<std::mutex> lock(recycledFilesMutex_);
+        if (recycledFiles_.size() < MaxRecycledFiles) {
+            // The file keeps its old id until it's reused, so it won't be mistaken for a live journal file
+            std::string recycledPath = fs::path(path).replace_extension(".free").string();
+            fs::rename(path, recycledPath);
+            recycledFiles_.push_back(recycledPath);
+            return;
+        }
+    }
+
+    LOG_INFO("Deleting journal file " << path);
+    fs::remove(path);
+}
+
+std::string Journal::takeRecycledFile() {
+    std::lock_guard<std::mutex> lock(recycledFilesMutex_);
+    if (recycledFiles_.empty()) {
+        return std::string();
+    }
+
+    std::string path = recycledFiles_.back();
+    recycledFiles_.pop_back();
+    return path;
+}
+
+JournalFilePtr Journal::createJournalFile() {
+    uint32_t fileId = nextFileId_++;
+    std::string path = JournalFile::path(directory_, fileId);
+
+    std::string recycledPath = directIo_ ? takeRecycledFile() : std::string();
+    if (!recycledPath.empty()) {
+        fs::rename(recycledPath, path);
+        LOG_INFO("Reusing journal file " << recycledPath << " as " << path);
+    } else {
+        LOG_INFO("Created journal file " << path);
+    }
+
+    JournalFilePtr file = std::make_shared<JournalFile>(directory_, fileId, directIo_, directIo_ ? maxFileSize_ : 0);
+
+    // The syncs of the file data don't cover its directory entry
+    syncDirectory();
+    return file;
+}
+
+bool Journal::spinRead(JournalEntry& entry) {
+    for (int i = 0; i < groupCommitPolicy_.spinIterations(); i++) {
+        if (journalQueue_.read(entry)) {
+            return true;
+        }
+
+        asm_volatile_pause();
+    }
+
+    return false;
+}
+
+void Journal::run() {
+    setThreadName(to<std::string>("bookie-wal-", journalId_));
+    CpuAffinity::pinCurrentThread(cpus_);
+
+    JournalEntry entry;
+    bool exiting = false;
+
+    while (!exiting) {
+        // Spin for a little while before parking the thread, to avoid paying for a wake-up when the entries are
+        // coming in bursts
+        if (!spinRead(entry)) {
+            journalQueue_.blockingRead(entry);
+        }
+
+        JournalWritePtr write = newWrite();
+        steady_clock::time_point batchStart = steady_clock::now();
+        size_t batchBytes = 0;
+
+        // Collect items from queue until the batch is complete
+        while (true) {
+            if (entry.isExitMarker()) {
+                // Journal is exiting, commit the entries collected so far before returning
+                exiting = true;
+                break;
+            }
+
+            entry.walTimeSpentInQueue.completed();
+            if (entry.promise) {
+                write->promises.emplace_back(std::move(entry.promise));
+            } else {
+                write->completions.emplace_back(std::move(entry.completion));
+            }
+
+            if (entry.entry.data) {
+                batchBytes += entry.entry.data->computeChainDataLength();
+                write->entries.emplace_back(std::move(entry.entry));
+            }
+
+            for (LogEntry& batchEntry : entry.batch) {
+                batchBytes += batchEntry.data->computeChainDataLength();
+                write->entries.emplace_back(std::move(batchEntry));
+            }
+            entry.batch.clear();
+
+            if (groupCommitPolicy_.isBatchFull(write->entries.size(), batchBytes, batchStart)) {
+                break;
+            }
+
+            if (spinRead(entry)) {
+                continue;
+            }
+
+            // Queue is drained
+            if (groupCommitPolicy_.flushWhenQueueEmpty()
+                    || !journalQueue_.tryReadUntil(groupCommitPolicy_.batchDeadline(batchStart), entry)) {
+                break;
+            }
+        }
+
+        if (write->entries.empty()) {
+            recycleWrite(std::move(write));
+            continue;
+        }
+
+        walBatchSize_->addValueSample(write->entries.size());
+        walBatchBytes_->addValueSample(batchBytes);
+
+        try {
+            writeBatch(*write);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to write journal batch: " << e.what());
+            write->error = e.what();
+
+            std::vector<AckBatch> ackBatches;
+            completeWrite(*write, false, ackBatches);
+            deliverAcks(ackBatches);
+            recycleWrite(std::move(write));
+
+            // Space might have been allocated in the file without being written, the replay would stop there
+            currentFile_.reset();
+            continue;
+        }
+
+        ioEngine_->submit(std::move(write));
+    }
+
+    ioEngine_->close();
+}
+
+void Journal::writeBatch(JournalWrite& write) {
+    size_t batchSize = 0;
+    for (const LogEntry& entry : write.entries) {
+        batchSize += sizeof(RecordHeader) + entry.data->computeChainDataLength();
+    }
+
+    if (directIo_) {
+        batchSize = RecordBatch::alignedSize(batchSize, AlignedBufferPool::Alignment);
+    }
+
+    // Preallocated files cannot grow past their size
+    bool fileFull = currentFile_ && currentFile_->size() > 0 && currentFile_->size() + batchSize > maxFileSize_;
+
+    if (!currentFile_ || fileFull || rollFile_.exchange(false)) {
+        // The previous file will still be synced by the I/O engine, for the batches that were written into it
+        currentFile_ = createJournalFile();
+    }
+
+    write.file = currentFile_;
+    write.records.reset(currentFile_->fileId(), write.entries);
+
+    if (directIo_) {
+        write.alignedBuffer = bufferPool_->get(batchSize);
+        write.records.copyAligned(write.alignedBuffer.data(), AlignedBufferPool::Alignment);
+    }
+
+    write.offset = currentFile_->allocate(write.records.size());
+}
+
+void Journal::runSync() {
+    setThreadName(to<std::string>("bookie-sync-", journalId_));
+    CpuAffinity::pinCurrentThread(cpus_);
+
+    ioEngine_->run(std::bind(&Journal::completeWrites, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+void Journal::completeWrites(std::vector<JournalWritePtr>& writes, steady_clock::duration syncLatency) {
+    size_t entries = 0;
+
+    for (auto& write : writes) {
+        entries += write->entries.size();
+
+        if (write->error.empty() && write->file->fileId() == failedFileId_) {
+            // A previous batch in this file has failed, the replay would not get past it
+            write->error = "Previous journal write failed";
+        }
+
+        if (!write->error.empty()) {
+            failedFileId_ = write->file->fileId();
+            rollFile_ = true;
+        }
+
+        completeWrite(*write, write->error.empty(), ackBatches_);
+        recycleWrite(std::move(write));
+    }
+
+    deliverAcks(ackBatches_);
+
+    walSyncLatency_->addLatencySample(duration_cast<Clock::duration>(syncLatency));
+    groupCommitPolicy_.onSyncCompleted(entries, syncLatency);
+}
+
+void Journal::completeWrite(JournalWrite& write, bool persisted, std::vector<AckBatch>& ackBatches) {
+    if (persisted) {
+        // Only the synced entries make it to the ledger storage, where the next checkpoint makes them durable
+        try {
+            storage_.addEntries(write.entries);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to add journal batch to the ledger storage: " << e.what());
+            write.error = e.what();
+            persisted = false;
+        }
+    }
+
+    if (persisted) {
+        {
+            // Only the batches added to the ledger storage move the mark, the failed ones are never checkpointed
+            std::lock_guard<std::mutex> lock(markMutex_);
+            lastMark_ = JournalMark { write.file->fileId(), write.offset + write.records.size() };
+        }
+
+        // Make the entries visible to the last entry queries before acknowledging them
+        storage_.entriesPersisted(write.entries);
+
+        Unit unit;
+        for (auto& pr : write.promises) {
+            pr->setValue(unit);
+        }
+    } else {
+        storage_.entriesFailed(write.entries);
+
+        for (auto& pr : write.promises) {
+            pr->setException(std::runtime_error(write.error));
+        }
+    }
+
+    AddStatus status = persisted ? AddStatus::Persisted : AddStatus::Failed;
+
+    // There are only a few event bases, one per IO thread
+    for (AddCompletion& completion : write.completions) {
+        auto it = std::find_if(ackBatches.begin(), ackBatches.end(), [&](const AckBatch& batch) {
+            return batch.eventBase == completion.eventBase;
+        });
+
+        if (it == ackBatches.end()) {
+            ackBatches.push_back(AckBatch { completion.eventBase, { } });
+            it = ackBatches.end() - 1;
+            it->acks.reserve(write.completions.size());
+        }
+
+        it->acks.push_back(Ack { std::move(completion.callback), status });
+    }
+}
+
+void Journal::deliverAcks(std::vector<AckBatch>& ackBatches) {
+    for (AckBatch& batch : ackBatches) {
+        if (!batch.eventBase) {
+            for (Ack& ack : batch.acks) {
+                ack.callback(ack.status);
+            }
+            continue;
+        }
+
+        // A single notification for all the acks going to this event base
+        batch.eventBase->runInEventBaseThread([acks = std::move(batch.acks)]() mutable {
+            for (Ack& ack : acks) {
+                ack.callback(ack.status);
+            }
+        });
+    }
+
+    ackBatches.clear();
+}
+
+JournalWritePtr Journal::newWrite() {
+    {
+        std::lock_guard<std::mutex> lock(writePoolMutex_);
+        if (!writePool_.empty()) {
+            JournalWritePtr write = std::move(writePool_.back());
+            writePool_.pop_back();
+            return write;
+        }
+    }
+
+    return make_unique<JournalWrite>();
+}
+
+void Journal::recycleWrite(JournalWritePtr write) {
+    // Release the payloads, the file and the aligned buffer, but keep the allocated capacity
+    write->file.reset();
+    write->offset = 0;
+    write->entries.clear();
+    write->alignedBuffer = AlignedBufferPool::Buffer();
+    write->promises.clear();
+    write->completions.clear();
+    write->error.clear();
+
+    std::lock_guard<std::mutex> lock(writePoolMutex_);
+    if (writePool_.size() < maxPooledWrites_) {
+        writePool_.push_back(std::move(write));
+    }
+}
+
+void Journal::replay() {
+    JournalMark mark = readLastMark();
+    LOG_INFO("Replaying journal " << directory_ << " from file " << mark.fileId << " at offset " << mark.offset);
+
+    // Files left aside for reuse by a previous run
+    for (fs::directory_iterator it(directory_); it != fs::directory_iterator(); ++it) {
+        if (it->path().extension() == ".free") {
+            std::string path = it->path().string();
+            if (directIo_ && recycledFiles_.size() < MaxRecycledFiles) {
+                recycledFiles_.push_back(path);
+            } else {
+                fs::remove(path);
+            }
+        }
+    }
+
+    size_t replayedEntries = 0;
+    for (uint32_t fileId : listJournalFiles()) {
+        if (fileId >= mark.fileId) {
+            replayedEntries += replayFile(fileId, fileId == mark.fileId ? mark.offset : 0);
+        } else {
+            // Already checkpointed
+            releaseFile(JournalFile::path(directory_, fileId));
+        }
+
+        nextFileId_ = std::max(nextFileId_, fileId + 1);
+    }
+
+    LOG_INFO("Replayed " << replayedEntries << " entries from journal " << directory_);
+}
+
+size_t Journal::replayFile(uint32_t fileId, uint64_t offset) {
+    File file(JournalFile::path(directory_, fileId), O_RDONLY | O_CLOEXEC);
+    checkUnixError(lseek(file.fd(), offset, SEEK_SET), "Failed to seek in journal file ", fileId);
+
+    std::vector<LogEntry> entries;
+    size_t replayedEntries = 0;
+
+    while (true) {
+        RecordHeader header;
+        if (readFull(file.fd(), &header, sizeof(header)) != sizeof(header) || !header.isValid(fileId)
+                || header.length > BookieConstant::MaxFrameSize) {
+            // Reached the end of the journal file, or a partially written record
+            break;
+        }
+
+        if (header.isPadding()) {
+            checkUnixError(lseek(file.fd(), header.length, SEEK_CUR), "Failed to seek in journal file ", fileId);
+            continue;
+        }
+
+        IOBufPtr data = IOBuf::create(header.length);
+        if (readFull(file.fd(), data->writableData(), header.length) != header.length) {
+            break;
+        }
+
+        data->append(header.length);
+        if (payloadChecksum(*data) != header.checksum) {
+            LOG_WARN("Checksum mismatch in journal file " << fileId << " for entry " //
+                    << header.ledgerId << ":" << header.entryId);
+            break;
+        }
+
+        entries.emplace_back(LogEntry { header.ledgerId, header.entryId, std::move(data), header.checksum });
+        if (entries.size() == 1000) {
+            storage_.addEntries(entries);
+            replayedEntries += entries.size();
+            entries.clear();
+        }
+    }
+
+    if (!entries.empty()) {
+        storage_.addEntries(entries);
+        replayedEntries += entries.size();
+    }
+
+    return replayedEntries;
+}
+
+JournalMark Journal::readLastMark() {
+    JournalMark mark { 0, 0 };
+    std::string path = directory_ + "/lastMark";
+    if (fs::exists(path)) {
+        File file(path, O_RDONLY | O_CLOEXEC);
+        if (readFull(file.fd(), &mark, sizeof(mark)) != sizeof(mark)) {
+            throw std::runtime_error("Corrupted journal mark file " + path);
+        }
+    }
+
+    return mark;
+}
+
+void Journal::writeLastMark(JournalMark mark) {
+    std::string path = directory_ + "/lastMark";
+    std::string tmpPath = path + ".tmp";
+
+    {
+        File file(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        checkUnixError(writeFull(file.fd(), &mark, sizeof(mark)), "Failed to write ", tmpPath);
+        checkUnixError(fsyncNoInt(file.fd()), "Failed to sync ", tmpPath);
+    }
+
+    checkUnixError(rename(tmpPath.c_str(), path.c_str()), "Failed to rename ", tmpPath);
+    syncDirectory();
+}
+
+void Journal::syncDirectory() {
+    File dir(directory_, O_RDONLY | O_CLOEXEC);
+    checkUnixError(fsyncNoInt(dir.fd()), "Failed to sync ", directory_);
+}
+
+std::vector<uint32_t> Journal::listJournalFiles() {
+    std::vector<uint32_t> fileIds;
+    for (fs::directory_iterator it(directory_); it != fs::directory_iterator(); ++it) {
+        if (it->path().extension() == ".journal") {
+            fileIds.push_back(std::stoul(it->path().stem().string(), nullptr, 16));
+        }
+    }
+
+    std::sort(fileIds.begin(), fileIds.end());
+    return fileIds;
+}
@@ -0,0 +1,208 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/futures/Future.h>
+#include <folly/io/IOBuf.h>
+#include <folly/MPMCQueue.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BookieConfig.h"
+#include "GroupCommitPolicy.h"
+#include "JournalFile.h"
+#include "JournalIoEngine.h"
+#include "LogRecord.h"
+#include "Metrics.h"
+
+using namespace folly;
+
+class Storage;
+
+/**
+ * Position in the journal up to which all the entries have been added to the ledger storage
+ */
+struct JournalMark {
+    uint32_t fileId;
+    uint64_t offset;
+};
+
+/**
+ * A journal lane. Each lane has its own queue, its own journal files and its own threads doing the group commit
+ * of the entries, so that multiple lanes can have fsyncs in flight at the same time.
+ *
+ * The commit is done in 2 stages: the journal thread submits the batches to the journal I/O engine, while the sync
+ * thread waits for the batches to be written and synced by the engine, adds their entries to the ledger storage and
+ * completes them. The next batch is being collected and written while the previous sync is still in progress.
+ *
+ * Journal files are deleted once a checkpoint has made all their entries durable in the ledger storage. Whatever
+ * is after the last checkpoint mark gets replayed into the ledger storage at startup.
+ *
+ * In direct I/O mode, the batches are copied into aligned buffers and padded to the block size, and the journal
+ * files are preallocated. Checkpointed files are kept aside and reused for the next journal files instead of being
+ * deleted, so that the writes land on already allocated blocks.
+ */
+class Journal {
+public:
+    Journal(int journalId, Storage& storage, const BookieConfig& conf, MetricsManager& metricsManager);
+    ~Journal();
+
+    /**
+     * Append an entry. The completion callback is invoked once the entry is durable, or if it failed to be written.
+     *
+     * @return false if the journal queue is full, in which case the entry is dropped and the callback not invoked
+     */
+    bool append(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion);
+
+    /**
+     * Append multiple entries with a single enqueue. The entries are committed together, in the same journal batch.
+     * The future fails right away if the journal queue is full.
+     */
+    Future<Unit> appendBatch(std::vector<LogEntry> entries);
+
+    JournalMark lastMark();
+
+    /**
+     * Called once all the entries before the mark are durable in the ledger storage
+     */
+    void checkpointCompleted(JournalMark mark);
+
+private:
+    void run();
+    void runSync();
+
+    void replay();
+    size_t replayFile(uint32_t fileId, uint64_t offset);
+
+    void writeBatch(JournalWrite& write);
+
+    /**
+     * Get a write from the pool of completed writes, which keep the capacity of their vectors, so that no
+     * allocation is needed in steady state
+     */
+    JournalWritePtr newWrite();
+    void recycleWrite(JournalWritePtr write);
+
+    JournalFilePtr createJournalFile();
+
+    /**
+     * Delete a journal file that is no longer needed, or keep it aside to be reused
+     */
+    void releaseFile(const std::string& path);
+    std::string takeRecycledFile();
+
+    void completeWrites(std::vector<JournalWritePtr>& writes, steady_clock::duration syncLatency);
+
+    struct Ack {
+        Function<void(AddStatus status)> callback;
+        AddStatus status;
+    };
+
+    struct AckBatch {
+        EventBase* eventBase;
+        std::vector<Ack> acks;
+    };
+
+    /**
+     * Complete the entries of a write and group their completion callbacks by event base
+     */
+    void completeWrite(JournalWrite& write, bool persisted, std::vector<AckBatch>& ackBatches);
+    void deliverAcks(std::vector<AckBatch>& ackBatches);
+
+    JournalMark readLastMark();
+    void writeLastMark(JournalMark mark);
+    std::vector<uint32_t> listJournalFiles();
+    void syncDirectory();
+
+    typedef std::unique_ptr<Promise<Unit>> PromisePtr;
+
+    struct JournalEntry {
+        LogEntry entry;
+
+        // Entries appended together, in which case the entry above is empty
+        std::vector<LogEntry> batch;
+
+        // Set for the entries appended with a completion callback, instead of the promise
+        AddCompletion completion;
+
+        PromisePtr promise;
+        Timer walTimeSpentInQueue;
+
+        bool isExitMarker() const {
+            return !promise && !completion.callback;
+        }
+    };
+
+    bool spinRead(JournalEntry& entry);
+
+    const int journalId_;
+    const std::string directory_;
+    Storage& storage_;
+
+    MPMCQueue<JournalEntry> journalQueue_;
+
+    const size_t maxFileSize_;
+    const bool directIo_;
+    GroupCommitPolicy groupCommitPolicy_;
+    std::unique_ptr<AlignedBufferPool> bufferPool_;
+    std::unique_ptr<JournalIoEngine> ioEngine_;
+
+    // Only accessed by the journal thread
+    JournalFilePtr currentFile_;
+    uint32_t nextFileId_;
+
+    // Set by the sync thread after a failed write, to have the journal thread move to a new file
+    std::atomic<bool> rollFile_;
+
+    // Only accessed by the sync thread
+    uint32_t failedFileId_;
+
+    std::mutex markMutex_;
+    JournalMark lastMark_;
+
+    std::mutex writePoolMutex_;
+    std::vector<JournalWritePtr> writePool_;
+    const size_t maxPooledWrites_;
+
+    // Only accessed by the sync thread
+    std::vector<AckBatch> ackBatches_;
+
+    // Checkpointed journal files waiting to be reused, in direct I/O mode
+    std::mutex recycledFilesMutex_;
+    std::vector<std::string> recycledFiles_;
+
+    // CPUs the journal and sync threads are pinned to
+    const std::vector<int> cpus_;
+
+    MetricPtr addEntryEnqueueLatency_;
+    MetricPtr walSyncLatency_;
+    MetricPtr walQueueLatency_;
+    MetricPtr walBatchSize_;
+    MetricPtr walBatchBytes_;
+
+    std::thread journalThread_;
+    std::thread syncThread_;
+};
@@ -0,0 +1,49 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "JournalFile.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace folly;
+
+JournalFile::JournalFile(const std::string& directory, uint32_t fileId, bool directIo, size_t preallocatedSize) :
+        fileId_(fileId),
+        // Reused files are not truncated, to keep their blocks allocated. Stale records are rejected by the replay
+        // since they carry the id of the previous file.
+        file_(path(directory, fileId), O_WRONLY | O_CREAT | O_CLOEXEC | (directIo ? O_DIRECT : O_TRUNC), 0644),
+        size_(0) {
+    if (preallocatedSize > 0) {
+        checkUnixError(fallocate(file_.fd(), 0, 0, preallocatedSize), "Failed to preallocate journal file ", fileId);
+    }
+}
+
+void JournalFile::sync() {
+    checkUnixError(fdatasyncNoInt(file_.fd()), "Failed to sync journal file ", fileId_);
+}
+
+std::string JournalFile::path(const std::string& directory, uint32_t fileId) {
+    return sformat("{}/{:08x}.journal", directory, fileId);
+}
@@ -0,0 +1,78 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+
+#include <cstdint>
+#include <string>
+
+using folly::File;
+
+/**
+ * An append-only journal file. Space for each batch is allocated by the journal thread, while the actual writes
+ * and syncs are done by the journal I/O engine.
+ *
+ * In direct I/O mode the file is opened with O_DIRECT and its blocks are preallocated, so that the writes never
+ * change the file size and the syncs don't need to flush any metadata. All the writes must then be aligned.
+ */
+class JournalFile {
+public:
+    /**
+     * @param preallocatedSize number of bytes to allocate on disk upfront, or 0 to grow the file as it gets written
+     */
+    JournalFile(const std::string& directory, uint32_t fileId, bool directIo = false, size_t preallocatedSize = 0);
+
+    uint32_t fileId() const {
+        return fileId_;
+    }
+
+    int fd() const {
+        return file_.fd();
+    }
+
+    /**
+     * @return the number of bytes allocated so far
+     */
+    size_t size() const {
+        return size_;
+    }
+
+    /**
+     * Allocate space at the end of the file
+     *
+     * @return the offset where the data should be written
+     */
+    uint64_t allocate(size_t length) {
+        uint64_t offset = size_;
+        size_ += length;
+        return offset;
+    }
+
+    void sync();
+
+    static std::string path(const std::string& directory, uint32_t fileId);
+
+private:
+    const uint32_t fileId_;
+    File file_;
+    size_t size_;
+};
@@ -0,0 +1,118 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "JournalIoEngine.h"
+#include "Logging.h"
+
+#ifdef BOOKIE_HAVE_LIBURING
+#include "IoUringJournalIoEngine.h"
+#endif
+
+DECLARE_LOG_OBJECT();
+
+std::unique_ptr<JournalIoEngine> JournalIoEngine::create(const std::string& type, bool fsync, int ioDepth) {
+    if (type == "io_uring") {
+#ifdef BOOKIE_HAVE_LIBURING
+        try {
+            return std::unique_ptr<JournalIoEngine>(new IoUringJournalIoEngine(fsync, ioDepth));
+        } catch (const std::exception& e) {
+            LOG_WARN("Failed to initialize io_uring journal engine, falling back to sync engine: " << e.what());
+        }
+#else
+        LOG_WARN("Bookie was built without io_uring support, falling back to sync journal engine");
+#endif
+    } else if (type != "sync") {
+        LOG_WARN("Unknown journal engine '" << type << "', falling back to sync journal engine");
+    }
+
+    return std::unique_ptr<JournalIoEngine>(new SyncJournalIoEngine(fsync));
+}
+
+SyncJournalIoEngine::SyncJournalIoEngine(bool fsync) :
+        fsync_(fsync),
+        syncQueue_(1000) {
+}
+
+void SyncJournalIoEngine::submit(JournalWritePtr write) {
+    write->submitTime = steady_clock::now();
+
+    try {
+        write->records.writeAt(write->file->fd(), write->offset);
+    } catch (const std::exception& e) {
+        write->error = e.what();
+    }
+
+    syncQueue_.blockingWrite(std::move(write));
+}
+
+void SyncJournalIoEngine::close() {
+    syncQueue_.blockingWrite(nullptr);
+}
+
+void SyncJournalIoEngine::run(const CompletionCallback& callback) {
+    std::vector<JournalWritePtr> writes;
+    JournalWritePtr write;
+    bool exiting = false;
+
+    while (!exiting) {
+        // Take all the batches that were written since the last sync
+        syncQueue_.blockingRead(write);
+        do {
+            if (write) {
+                writes.emplace_back(std::move(write));
+            } else {
+                exiting = true;
+            }
+        } while (syncQueue_.read(write));
+
+        if (writes.empty()) {
+            continue;
+        }
+
+        steady_clock::time_point syncStart = steady_clock::now();
+
+        if (fsync_) {
+            // Batches are in order, so each file only needs to be synced once
+            JournalFile* lastSyncedFile = nullptr;
+            std::string error;
+
+            for (auto& w : writes) {
+                if (w->file.get() != lastSyncedFile) {
+                    try {
+                        w->file->sync();
+                        error.clear();
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("Failed to sync journal file " << w->file->fileId() << ": " << e.what());
+                        error = e.what();
+                    }
+
+                    lastSyncedFile = w->file.get();
+                }
+
+                if (!error.empty() && w->error.empty()) {
+                    w->error = error;
+                }
+            }
+        }
+
+        callback(writes, steady_clock::now() - syncStart);
+        writes.clear();
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/Function.h>
+#include <folly/MPMCQueue.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AlignedBufferPool.h"
+#include "JournalFile.h"
+#include "LogRecord.h"
+
+using namespace folly;
+using namespace std::chrono;
+
+typedef std::shared_ptr<JournalFile> JournalFilePtr;
+
+/**
+ * Outcome of an entry given to the bookie
+ */
+enum class AddStatus {
+    Persisted,
+    Failed,
+
+    // Not taken because the bookie is overloaded, the client can retry later
+    Rejected,
+};
+
+/**
+ * Completion of an entry appended to the journal. The callbacks of a journal batch are delivered with a single hop
+ * to each event base, or directly on the journal sync thread if the event base is null.
+ */
+struct AddCompletion {
+    EventBase* eventBase;
+    Function<void(AddStatus status)> callback;
+};
+
+/**
+ * A batch of journal records on its way to the disk
+ */
+struct JournalWrite {
+    JournalFilePtr file;
+    uint64_t offset;
+
+    // The entries are owning the payloads referenced by the records
+    std::vector<LogEntry> entries;
+    RecordBatch records;
+
+    // In direct I/O mode, holds the copy of the records the batch is written from
+    AlignedBufferPool::Buffer alignedBuffer;
+
+    std::vector<std::unique_ptr<Promise<Unit>>> promises;
+    std::vector<AddCompletion> completions;
+
+    steady_clock::time_point submitTime;
+
+    // Set if the write or the sync have failed
+    std::string error;
+};
+
+typedef std::unique_ptr<JournalWrite> JournalWritePtr;
+
+/**
+ * Performs the journal writes and syncs.
+ *
+ * Writes are submitted by the journal thread, while run() is executed by the journal sync thread and reports the
+ * completed writes, always in the order in which they were submitted.
+ */
+class JournalIoEngine {
+public:
+    typedef std::function<void(std::vector<JournalWritePtr>& writes, steady_clock::duration syncLatency)> //
+    CompletionCallback;
+
+    virtual ~JournalIoEngine() {
+    }
+
+    virtual void submit(JournalWritePtr write) = 0;
+
+    /**
+     * Stop accepting writes. run() will return once all the submitted writes are completed.
+     */
+    virtual void close() = 0;
+
+    virtual void run(const CompletionCallback& callback) = 0;
+
+    /**
+     * Create the engine of the given type ("sync" or "io_uring"), falling back to the "sync" engine if the requested
+     * one is not available
+     */
+    static std::unique_ptr<JournalIoEngine> create(const std::string& type, bool fsync, int ioDepth);
+};
+
+/**
+ * Writes each batch with pwritev() from the journal thread, then syncs with fdatasync() all the batches written
+ * since the previous sync
+ */
+class SyncJournalIoEngine: public JournalIoEngine {
+public:
+    explicit SyncJournalIoEngine(bool fsync);
+
+    void submit(JournalWritePtr write) override;
+
+    void close() override;
+
+    void run(const CompletionCallback& callback) override;
+
+private:
+    const bool fsync_;
+    MPMCQueue<JournalWritePtr> syncQueue_;
+};
@@ -0,0 +1,231 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "BookieProtocol.h"
+#include "LedgerDirectory.h"
+
+#include <folly/Hash.h>
+#include <folly/ThreadName.h>
+
+#include <algorithm>
+#include <iterator>
+
+LedgerDirectory::LedgerDirectory(Loader loader) :
+        loader_(std::move(loader)),
+        timeoutsMutex_(),
+        timeoutsCondition_(),
+        deadlines_(),
+        stopping_(false),
+        timeoutsThread_(std::bind(&LedgerDirectory::runTimeouts, this)) {
+}
+
+LedgerDirectory::~LedgerDirectory() {
+    {
+        std::lock_guard<std::mutex> lock(timeoutsMutex_);
+        stopping_ = true;
+    }
+    timeoutsCondition_.notify_all();
+    timeoutsThread_.join();
+
+    // Release the readers still waiting
+    while (!deadlines_.empty()) {
+        deadlines_.top().second->complete(false);
+        deadlines_.pop();
+    }
+}
+
+bool LedgerDirectory::get(int64_t ledgerId, LedgerInfo& info) {
+    Segment& segment = segmentFor(ledgerId);
+
+    {
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        auto it = segment.ledgers.find(ledgerId);
+        if (it != segment.ledgers.end() && it->second.loaded) {
+            info = it->second.info;
+            return info.entryCount > 0;
+        }
+    }
+
+    // Don't hold the lock while reading the index, the journals need it to complete their batches
+    LedgerInfo storedInfo = loader_(ledgerId);
+
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    auto it = segment.ledgers.find(ledgerId);
+    if (it == segment.ledgers.end()) {
+        if (storedInfo.entryCount == 0) {
+            // Not kept, the lookups of ledgers that don't exist would otherwise fill up the table
+            info = LedgerInfo { BookieConstant::InvalidEntryId, 0, 0 };
+            return false;
+        }
+
+        it = segment.ledgers.emplace(ledgerId,
+                LedgerState { LedgerInfo { BookieConstant::InvalidEntryId, 0, 0 }, false, { } }).first;
+    }
+
+    LedgerState& state = it->second;
+    if (!state.loaded) {
+        // Merge with the entries added since startup
+        state.info.lastEntryId = std::max(state.info.lastEntryId, storedInfo.lastEntryId);
+        state.info.entryCount += storedInfo.entryCount;
+        state.info.size += storedInfo.size;
+        state.loaded = true;
+    }
+
+    info = state.info;
+    return info.entryCount > 0;
+}
+
+void LedgerDirectory::addEntries(const std::vector<LogEntry>& entries) {
+    std::vector<WaiterPtr> readyWaiters;
+
+    for (const LogEntry& entry : entries) {
+        Segment& segment = segmentFor(entry.ledgerId);
+
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        auto res = segment.ledgers.emplace(entry.ledgerId,
+                LedgerState { LedgerInfo { BookieConstant::InvalidEntryId, 0, 0 }, false, { } });
+        LedgerState& state = res.first->second;
+
+        if (entry.entryId > state.info.lastEntryId) {
+            state.info.lastEntryId = entry.entryId;
+            state.info.entryCount += 1;
+            state.info.size += entry.data->computeChainDataLength();
+        }
+
+        if (!state.waiters.empty()) {
+            // Waiters are only parked on loaded ledgers, so the last entry id is complete
+            auto ready = std::partition(state.waiters.begin(), state.waiters.end(), [&](const WaiterPtr& waiter) {
+                return waiter->previousEntryId >= state.info.lastEntryId;
+            });
+
+            std::move(ready, state.waiters.end(), std::back_inserter(readyWaiters));
+            state.waiters.erase(ready, state.waiters.end());
+        }
+    }
+
+    // Complete the waiters outside of the locks, the callbacks are only scheduling the responses on the IO threads
+    for (const WaiterPtr& waiter : readyWaiters) {
+        waiter->complete(true);
+    }
+}
+
+Future<bool> LedgerDirectory::waitForEntry(int64_t ledgerId, int64_t previousEntryId,
+        steady_clock::duration timeout) {
+    LedgerInfo info;
+    if (get(ledgerId, info) && info.lastEntryId > previousEntryId) {
+        return makeFuture(true);
+    }
+
+    WaiterPtr waiter = std::make_shared<Waiter>();
+    waiter->ledgerId = ledgerId;
+    waiter->previousEntryId = previousEntryId;
+    waiter->completed = false;
+    Future<bool> future = waiter->promise.getFuture();
+
+    {
+        // Check again under the lock, an entry might have been added since the last check
+        Segment& segment = segmentFor(ledgerId);
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        auto res = segment.ledgers.emplace(ledgerId,
+                LedgerState { LedgerInfo { BookieConstant::InvalidEntryId, 0, 0 }, true, { } });
+        LedgerState& state = res.first->second;
+
+        // A ledger missing from the table has no stored entries, only the ones added since the check, if any
+        state.loaded = true;
+        if (state.info.lastEntryId > previousEntryId) {
+            return makeFuture(true);
+        }
+
+        state.waiters.push_back(waiter);
+    }
+
+    steady_clock::time_point deadline = steady_clock::now() + timeout;
+
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(timeoutsMutex_);
+        if (stopping_) {
+            waiter->complete(false);
+            return future;
+        }
+
+        earliest = deadlines_.empty() || deadline < deadlines_.top().first;
+        deadlines_.emplace(deadline, std::move(waiter));
+    }
+
+    if (earliest) {
+        timeoutsCondition_.notify_one();
+    }
+
+    return future;
+}
+
+void LedgerDirectory::runTimeouts() {
+    setThreadName("bookie-longpoll");
+
+    std::unique_lock<std::mutex> lock(timeoutsMutex_);
+    while (!stopping_) {
+        if (deadlines_.empty()) {
+            timeoutsCondition_.wait(lock);
+            continue;
+        }
+
+        if (deadlines_.top().first > steady_clock::now()) {
+            timeoutsCondition_.wait_until(lock, deadlines_.top().first);
+            continue;
+        }
+
+        WaiterPtr waiter = deadlines_.top().second;
+        deadlines_.pop();
+
+        if (!waiter->completed) {
+            lock.unlock();
+            removeWaiter(waiter);
+            waiter->complete(false);
+            lock.lock();
+        }
+    }
+}
+
+void LedgerDirectory::removeWaiter(const WaiterPtr& waiter) {
+    Segment& segment = segmentFor(waiter->ledgerId);
+    std::lock_guard<std::mutex> lock(segment.mutex);
+
+    auto it = segment.ledgers.find(waiter->ledgerId);
+    if (it != segment.ledgers.end()) {
+        std::vector<WaiterPtr>& waiters = it->second.waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), waiter), waiters.end());
+
+        // The ledger was only kept for its waiters
+        if (waiters.empty() && it->second.info.entryCount == 0) {
+            segment.ledgers.erase(it);
+        }
+    }
+}
+
+void LedgerDirectory::Waiter::complete(bool hasNewEntries) {
+    if (!completed.exchange(true)) {
+        promise.setValue(hasNewEntries);
+    }
+}
+
+LedgerDirectory::Segment& LedgerDirectory::segmentFor(int64_t ledgerId) {
+    return segments_[hash::twang_mix64(ledgerId) % NumSegments];
+}
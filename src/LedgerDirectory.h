@@ -0,0 +1,141 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/futures/Future.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LogRecord.h"
+
+using namespace folly;
+using namespace std::chrono;
+
+struct LedgerInfo {
+    int64_t lastEntryId;
+    int64_t entryCount;
+
+    // Total size of the entries payloads
+    int64_t size;
+};
+
+/**
+ * In-memory table of the ledgers with persisted entries, to answer the last entry queries without going to the
+ * index.
+ *
+ * The table is updated as the journal batches are synced. The ledgers written before the bookie was started are
+ * loaded on their first access, from their metadata stored with the index as it was at startup. The ledgers without entries are only kept while
+ * readers are waiting for them.
+ *
+ * Readers waiting for new entries are parked in a wait list of the ledger, which is signaled when the entries are
+ * added. Their timeouts are all handled by a single thread.
+ */
+class LedgerDirectory {
+public:
+    /**
+     * Loads the info of a ledger from the entries stored before startup. A ledger without entries has an entry count
+     * of 0.
+     */
+    typedef std::function<LedgerInfo(int64_t ledgerId)> Loader;
+
+    explicit LedgerDirectory(Loader loader);
+    ~LedgerDirectory();
+
+    /**
+     * @return false if the ledger has no persisted entries
+     */
+    bool get(int64_t ledgerId, LedgerInfo& info);
+
+    /**
+     * Called once the entries are durable. Entries are expected to be added in order within a ledger, an entry that
+     * is not after the last one is considered as a retry and not counted again.
+     */
+    void addEntries(const std::vector<LogEntry>& entries);
+
+    /**
+     * Wait until the ledger has an entry after previousEntryId
+     *
+     * @return a future set to true once there is a new entry, or to false if the timeout expires first
+     */
+    Future<bool> waitForEntry(int64_t ledgerId, int64_t previousEntryId, steady_clock::duration timeout);
+
+private:
+    struct Waiter {
+        int64_t ledgerId;
+        int64_t previousEntryId;
+        Promise<bool> promise;
+
+        // Set by whoever completes the waiter first, between the ledger update and the timeout
+        std::atomic<bool> completed;
+
+        void complete(bool hasNewEntries);
+    };
+
+    typedef std::shared_ptr<Waiter> WaiterPtr;
+
+    struct LedgerState {
+        LedgerInfo info;
+
+        // Whether the entries stored before startup are accounted for
+        bool loaded;
+
+        std::vector<WaiterPtr> waiters;
+    };
+
+    struct Segment {
+        std::mutex mutex;
+        std::unordered_map<int64_t, LedgerState> ledgers;
+    };
+
+    Segment& segmentFor(int64_t ledgerId);
+
+    void runTimeouts();
+    void removeWaiter(const WaiterPtr& waiter);
+
+    static const int NumSegments = 16;
+
+    const Loader loader_;
+    Segment segments_[NumSegments];
+
+    typedef std::pair<steady_clock::time_point, WaiterPtr> Deadline;
+
+    struct LaterDeadline {
+        bool operator()(const Deadline& a, const Deadline& b) const {
+            return a.first > b.first;
+        }
+    };
+
+    std::mutex timeoutsMutex_;
+    std::condition_variable timeoutsCondition_;
+    std::priority_queue<Deadline, std::vector<Deadline>, LaterDeadline> deadlines_;
+    bool stopping_;
+    std::thread timeoutsThread_;
+};
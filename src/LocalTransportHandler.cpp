@@ -0,0 +1,246 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "LocalTransportHandler.h"
+#include "Logging.h"
+
+#include <folly/Conv.h>
+
+#include <atomic>
+
+#include <unistd.h>
+
+DECLARE_LOG_OBJECT();
+
+static const int MaxRequestsPerDrain = 1024;
+
+// Responses waiting for room in the ring after which the requests are no longer read
+static const size_t MaxPendingResponses = 1024;
+
+static const milliseconds MinFlushDelay(1);
+static const milliseconds MaxFlushDelay(100);
+
+static const uint8_t Doorbell = 1;
+
+LocalTransportHandler::LocalTransportHandler(size_t ringCapacity) :
+        ringCapacity_(ringCapacity),
+        channel_(),
+        decoder_(false),
+        drainScheduled_(false),
+        pendingResponses_(),
+        flushScheduled_(false),
+        flushDelay_(MinFlushDelay),
+        requestsPaused_(false) {
+}
+
+void LocalTransportHandler::transportActive(Context* ctx) {
+    static std::atomic<int> channelIdGenerator(0);
+    std::string name = to<std::string>("/bookie-", getpid(), "-", channelIdGenerator++);
+
+    try {
+        channel_ = ShmChannel::create(name, ringCapacity_);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to create the rings of a local connection: " << e.what());
+        ctx->fireClose();
+        return;
+    }
+
+    // Handshake: the length prefixed name of the segment, which the client maps and then unlinks
+    IOBufPtr handshake = IOBuf::create(sizeof(int32_t) + name.size());
+    handshake->append(sizeof(int32_t) + name.size());
+
+    io::RWPrivateCursor writer(handshake.get());
+    writer.writeBE<int32_t>(name.size());
+    writer.push((const uint8_t*) name.data(), name.size());
+    ctx->fireWrite(std::move(handshake));
+
+    ctx->fireTransportActive();
+}
+
+void LocalTransportHandler::read(Context* ctx, IOBufQueue& queue) {
+    // Only the doorbells are received from the socket, the requests are in the ring
+    queue.move();
+
+    if (channel_) {
+        drainRequests(ctx);
+    }
+}
+
+void LocalTransportHandler::drainRequests(Context* ctx) {
+    ShmRing& requests = channel_->requests();
+    std::shared_ptr<AsyncTransportWrapper> transport = ctx->getTransport();
+
+    try {
+        for (int i = 0; i < MaxRequestsPerDrain; i++) {
+            if (!transport->getReadCallback()) {
+                // The bookie handler paused the reads because of the overload, the requests stay in the ring
+                scheduleDrain(ctx, milliseconds(1));
+                return;
+            }
+
+            if (pendingResponses_.size() >= MaxPendingResponses) {
+                // The client is not consuming its responses, resumed by the flush once it catches up
+                LOG_DEBUG("Too many pending responses, pausing the requests of a local connection");
+                requestsPaused_ = true;
+                return;
+            }
+
+            size_t size;
+            const uint8_t* frame = requests.peek(size);
+            if (!frame) {
+                if (requests.prepareToWait()) {
+                    // The client rings the doorbell with its next request
+                    return;
+                }
+                continue;
+            }
+
+            size_t frameSize = size - sizeof(int32_t);
+            if (frameSize < sizeof(int32_t) || frameSize > BookieConstant::MaxFrameSize) {
+                LOG_WARN("Invalid frame size: " << frameSize);
+                ctx->fireClose();
+                return;
+            }
+
+            // Decode in place, the payloads are copied out before the room of the frame is reused
+            IOBuf buffer(IOBuf::WRAP_BUFFER, frame + sizeof(int32_t), frameSize);
+            io::Cursor reader(&buffer);
+
+            Request request;
+            bool valid = decoder_.decode(reader, frameSize, request);
+            requests.consume(size);
+            if (!valid) {
+                ctx->fireClose();
+                return;
+            }
+
+            LOG_DEBUG("Deserialized request: " << request);
+            ctx->fireRead(std::move(request));
+        }
+    } catch (const std::exception& e) {
+        LOG_WARN("Closing local connection: " << e.what());
+        ctx->fireClose();
+        return;
+    }
+
+    // Give the other connections of the thread a chance before draining the rest
+    scheduleDrain(ctx, milliseconds(0));
+}
+
+void LocalTransportHandler::scheduleDrain(Context* ctx, milliseconds delay) {
+    if (drainScheduled_) {
+        return;
+    }
+
+    drainScheduled_ = true;
+    std::weak_ptr<PipelineBase> pipeline = ctx->getPipelineShared();
+
+    ctx->getTransport()->getEventBase()->runAfterDelay([=] {
+        if (!pipeline.lock()) {
+            return;
+        }
+
+        drainScheduled_ = false;
+        drainRequests(ctx);
+    }, delay.count());
+}
+
+Future<Unit> LocalTransportHandler::write(Context* ctx, Response response) {
+    LOG_DEBUG("Serializing response: " << response);
+
+    if (!channel_ || (pendingResponses_.empty() && writeResponse(ctx, response))) {
+        return makeFuture();
+    }
+
+    // Keep the order of the responses until the client catches up
+    pendingResponses_.emplace_back(std::move(response));
+    scheduleFlush(ctx);
+    return makeFuture();
+}
+
+bool LocalTransportHandler::writeResponse(Context* ctx, Response& response) {
+    int headerSize;
+    const int frameSize = BookieResponseEncoder::frameSize(response, headerSize);
+    const size_t size = sizeof(int32_t) + frameSize;
+
+    ShmRing& responses = channel_->responses();
+    uint8_t* frame = responses.reserve(size);
+    if (!frame) {
+        return false;
+    }
+
+    // The frame is serialized straight into the ring, payloads included
+    IOBuf buffer(IOBuf::WRAP_BUFFER, frame, size);
+    io::RWPrivateCursor writer(&buffer);
+    BookieResponseEncoder::writeHeader(writer, response, frameSize);
+
+    IOBufPtr payload = BookieResponseEncoder::takePayload(response);
+    if (payload) {
+        for (ByteRange range : *payload) {
+            writer.push(range.data(), range.size());
+        }
+    }
+
+    if (responses.commit(size)) {
+        ctx->fireWrite(IOBuf::copyBuffer(&Doorbell, sizeof(Doorbell))).onError([](const std::exception& e) {
+            LOG_WARN("Failed to wake up the local client: " << e.what());
+        });
+    }
+
+    return true;
+}
+
+void LocalTransportHandler::flushPendingResponses(Context* ctx) {
+    size_t flushed = 0;
+    while (!pendingResponses_.empty() && writeResponse(ctx, pendingResponses_.front())) {
+        pendingResponses_.pop_front();
+        ++flushed;
+    }
+
+    // Back off while the client is stalled, to not keep waking up the IO thread for nothing
+    flushDelay_ = flushed > 0 ? MinFlushDelay : std::min(flushDelay_ * 2, MaxFlushDelay);
+
+    if (requestsPaused_ && pendingResponses_.size() < MaxPendingResponses / 2) {
+        requestsPaused_ = false;
+        scheduleDrain(ctx, milliseconds(0));
+    }
+
+    if (!pendingResponses_.empty()) {
+        scheduleFlush(ctx);
+    }
+}
+
+void LocalTransportHandler::scheduleFlush(Context* ctx) {
+    if (flushScheduled_) {
+        return;
+    }
+
+    flushScheduled_ = true;
+    std::weak_ptr<PipelineBase> pipeline = ctx->getPipelineShared();
+
+    ctx->getTransport()->getEventBase()->runAfterDelay([=] {
+        if (!pipeline.lock()) {
+            return;
+        }
+
+        flushScheduled_ = false;
+        flushPendingResponses(ctx);
+    }, flushDelay_.count());
+}
@@ -0,0 +1,84 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <wangle/channel/Handler.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+
+#include "BookieCodecV2.h"
+#include "BookieProtocol.h"
+#include "ShmRing.h"
+
+using namespace std::chrono;
+using namespace wangle;
+using namespace folly;
+
+/**
+ * Transport for the clients running on the same host as the bookie. The client connects to a Unix domain socket, and
+ * the bookie answers with the name of a shared memory segment holding a request ring and a response ring. The frames
+ * in the rings are in the V2 wire format, and the requests are decoded in place and handed to the bookie handler like
+ * the ones received over TCP.
+ *
+ * After the handshake, the socket only carries the doorbells of the sides sleeping on an empty ring. As long as both
+ * sides keep up, the requests and the responses go through the rings without any system call.
+ *
+ * When the client stops consuming its responses, they are kept aside and retried with an increasing delay. Once too
+ * many of them are waiting, no more requests are read from the ring until the client catches up.
+ */
+class LocalTransportHandler: public Handler<IOBufQueue&, Request, Response, IOBufPtr> {
+public:
+    explicit LocalTransportHandler(size_t ringCapacity);
+
+    void transportActive(Context* ctx) override;
+
+    void read(Context* ctx, IOBufQueue& queue) override;
+
+    Future<Unit> write(Context* ctx, Response response) override;
+
+private:
+    void drainRequests(Context* ctx);
+    void scheduleDrain(Context* ctx, milliseconds delay);
+
+    /**
+     * @return false if the response ring is too full, in which case the response is left untouched
+     */
+    bool writeResponse(Context* ctx, Response& response);
+    void flushPendingResponses(Context* ctx);
+    void scheduleFlush(Context* ctx);
+
+    const size_t ringCapacity_;
+    std::unique_ptr<ShmChannel> channel_;
+
+    // The frames are overwritten once consumed, their large payloads can't be shared
+    BookieRequestDecoder decoder_;
+    bool drainScheduled_;
+
+    // Responses waiting for the client to make room in the ring
+    std::deque<Response> pendingResponses_;
+    bool flushScheduled_;
+    milliseconds flushDelay_;
+
+    // Set when the requests are no longer read because of the pending responses
+    bool requestsPaused_;
+};
@@ -0,0 +1,141 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "LogRecord.h"
+
+#include <folly/Checksum.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <limits.h>
+
+using namespace folly;
+
+constexpr uint32_t RecordHeader::Magic;
+constexpr int64_t RecordHeader::PaddingLedgerId;
+
+RecordHeader RecordHeader::forEntry(uint32_t logId, const LogEntry& entry) {
+    RecordHeader header;
+    header.length = entry.data->computeChainDataLength();
+    header.checksum = entry.checksum;
+    header.ledgerId = entry.ledgerId;
+    header.entryId = entry.entryId;
+    header.logId = logId;
+    header.magic = Magic;
+    return header;
+}
+
+RecordHeader RecordHeader::padding(uint32_t logId, uint32_t length) {
+    RecordHeader header;
+    header.length = length;
+    header.checksum = 0;
+    header.ledgerId = PaddingLedgerId;
+    header.entryId = PaddingLedgerId;
+    header.logId = logId;
+    header.magic = Magic;
+    return header;
+}
+
+uint32_t payloadChecksum(const IOBuf& payload) {
+    uint32_t checksum = ~0U;
+    for (ByteRange range : payload) {
+        checksum = crc32c(range.data(), range.size(), checksum);
+    }
+    return checksum;
+}
+
+RecordBatch::RecordBatch() :
+        logId_(0),
+        headers_(),
+        iovecs_(),
+        size_(0) {
+}
+
+void RecordBatch::reset(uint32_t logId, const std::vector<LogEntry>& entries) {
+    logId_ = logId;
+    headers_.clear();
+    iovecs_.clear();
+    size_ = 0;
+
+    // Headers must not be reallocated once the iovecs are pointing to them
+    headers_.reserve(entries.size());
+
+    for (const LogEntry& entry : entries) {
+        headers_.push_back(RecordHeader::forEntry(logId, entry));
+        iovecs_.push_back(iovec { &headers_.back(), sizeof(RecordHeader) });
+
+        for (ByteRange range : *entry.data) {
+            if (!range.empty()) {
+                iovecs_.push_back(iovec { (void*) range.data(), range.size() });
+            }
+        }
+
+        size_ += sizeof(RecordHeader) + headers_.back().length;
+    }
+}
+
+void RecordBatch::copyAligned(char* buffer, size_t alignment) {
+    char* p = buffer;
+    for (const iovec& iov : iovecs_) {
+        memcpy(p, iov.iov_base, iov.iov_len);
+        p += iov.iov_len;
+    }
+
+    size_t alignedLength = alignedSize(size_, alignment);
+    if (alignedLength > size_) {
+        RecordHeader header = RecordHeader::padding(logId_, alignedLength - size_ - sizeof(RecordHeader));
+        memcpy(p, &header, sizeof(header));
+        memset(p + sizeof(header), 0, header.length);
+    }
+
+    iovecs_.assign(1, iovec { buffer, alignedLength });
+    size_ = alignedLength;
+}
+
+size_t RecordBatch::alignedSize(size_t size, size_t alignment) {
+    size_t alignedLength = (size + alignment - 1) / alignment * alignment;
+
+    // The padding must have room for its own header
+    if (alignedLength > size && alignedLength - size < sizeof(RecordHeader)) {
+        alignedLength += alignment;
+    }
+
+    return alignedLength;
+}
+
+void RecordBatch::writeTo(int fd) {
+    // writev() doesn't accept more than IOV_MAX buffers at once
+    for (size_t i = 0; i < iovecs_.size(); i += IOV_MAX) {
+        int count = std::min<size_t>(IOV_MAX, iovecs_.size() - i);
+        checkUnixError(writevFull(fd, &iovecs_[i], count), "Failed to write records");
+    }
+}
+
+void RecordBatch::writeAt(int fd, uint64_t offset) {
+    for (size_t i = 0; i < iovecs_.size(); i += IOV_MAX) {
+        int count = std::min<size_t>(IOV_MAX, iovecs_.size() - i);
+        ssize_t written = pwritevFull(fd, &iovecs_[i], count, offset);
+        checkUnixError(written, "Failed to write records");
+        offset += written;
+    }
+}
@@ -0,0 +1,140 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+using folly::IOBuf;
+typedef std::unique_ptr<IOBuf> IOBufPtr;
+
+/**
+ * An entry on its way to the journal and the entry log
+ */
+struct LogEntry {
+    int64_t ledgerId;
+    int64_t entryId;
+    IOBufPtr data;
+    uint32_t checksum;
+};
+
+/**
+ * Header preceding each entry in the journal and in the entry log files. Fields are stored in host byte order.
+ */
+struct RecordHeader {
+    // Length of the payload following the header
+    uint32_t length;
+
+    // crc32c of the payload
+    uint32_t checksum;
+
+    int64_t ledgerId;
+    int64_t entryId;
+
+    // Id of the file the record was written into, to tell apart records left over in reused files
+    uint32_t logId;
+
+    uint32_t magic;
+
+    static constexpr uint32_t Magic = 0x424b4c52;
+
+    // Ledger id of the filler records used to pad the aligned journal writes
+    static constexpr int64_t PaddingLedgerId = -1;
+
+    static RecordHeader forEntry(uint32_t logId, const LogEntry& entry);
+
+    static RecordHeader padding(uint32_t logId, uint32_t length);
+
+    bool isPadding() const {
+        return ledgerId == PaddingLedgerId;
+    }
+
+    bool isValid(uint32_t expectedLogId) const {
+        return magic == Magic && logId == expectedLogId;
+    }
+};
+
+static_assert(sizeof(RecordHeader) == 32, "Unexpected record header size");
+
+uint32_t payloadChecksum(const IOBuf& payload);
+
+/**
+ * Scatter-gather list of the records for a batch of entries. The iovecs point directly into the entries payload
+ * buffers, so the payloads are never copied before reaching the file.
+ */
+class RecordBatch {
+public:
+    RecordBatch();
+
+    /**
+     * Prepare the records for the entries. The entries must stay alive until the batch is written.
+     */
+    void reset(uint32_t logId, const std::vector<LogEntry>& entries);
+
+    /**
+     * @return the total size of the records in bytes
+     */
+    size_t size() const {
+        return size_;
+    }
+
+    const std::vector<RecordHeader>& headers() const {
+        return headers_;
+    }
+
+    std::vector<iovec>& iovecs() {
+        return iovecs_;
+    }
+
+    /**
+     * Copy all the records into an aligned buffer, followed by a padding record up to the next multiple of the
+     * alignment. After this, the batch is made of a single iovec pointing to the buffer.
+     *
+     * @param buffer a buffer of at least alignedSize(size(), alignment) bytes
+     */
+    void copyAligned(char* buffer, size_t alignment);
+
+    /**
+     * @return the size of the records once padded to the alignment
+     */
+    static size_t alignedSize(size_t size, size_t alignment);
+
+    /**
+     * Write all the records at the current position of the file
+     */
+    void writeTo(int fd);
+
+    /**
+     * Write all the records at the given offset of the file
+     */
+    void writeAt(int fd, uint64_t offset);
+
+private:
+    uint32_t logId_;
+    std::vector<RecordHeader> headers_;
+    std::vector<iovec> iovecs_;
+    size_t size_;
+};
@@ -0,0 +1,109 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "MemoryAccountant.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+DECLARE_LOG_OBJECT();
+
+static const char* consumerNames[MemoryAccountant::NumConsumers] = { "pendingAdds", "writeCache", "readAheadCache" };
+
+MemoryAccountant::MemoryAccountant(size_t limit, MetricsManager& metricsManager, const std::string& gaugeSuffix,
+        PinnedRatio pinnedRatio) :
+        limit_(limit),
+        shedThreshold_(limit / 10 * 9),
+        used_(0),
+        pinnedRatio_(std::move(pinnedRatio)),
+        reclaimMutex_(),
+        reclaimers_(),
+        metricsManager_(metricsManager),
+        gaugeSuffix_(gaugeSuffix) {
+    metricsManager_.registerGauge("memoryUsage" + gaugeSuffix_, [this] {
+        return (double) used_;
+    });
+
+    metricsManager_.registerGauge("memoryPinned" + gaugeSuffix_, [this] {
+        return (double) pinned();
+    });
+
+    for (int i = 0; i < NumConsumers; i++) {
+        usage_[i] = 0;
+        metricsManager_.registerGauge(std::string("memoryUsage-") + consumerNames[i] + gaugeSuffix_, [this, i] {
+            return (double) usage_[i];
+        });
+    }
+}
+
+MemoryAccountant::~MemoryAccountant() {
+    metricsManager_.removeGauge("memoryUsage" + gaugeSuffix_);
+    metricsManager_.removeGauge("memoryPinned" + gaugeSuffix_);
+    for (int i = 0; i < NumConsumers; i++) {
+        metricsManager_.removeGauge(std::string("memoryUsage-") + consumerNames[i] + gaugeSuffix_);
+    }
+}
+
+size_t MemoryAccountant::pinned() const {
+    size_t received = usage_[(int) Consumer::PendingAdds] + usage_[(int) Consumer::WriteCache];
+    return (size_t) (received * pinnedRatio(Consumer::PendingAdds)) + usage_[(int) Consumer::ReadAheadCache];
+}
+
+double MemoryAccountant::pinnedRatio(Consumer consumer) const {
+    if (consumer == Consumer::ReadAheadCache || !pinnedRatio_) {
+        return 1.0;
+    }
+
+    return std::max(1.0, pinnedRatio_());
+}
+
+void MemoryAccountant::addReclaimer(Consumer consumer, Reclaimer reclaimer) {
+    std::lock_guard<std::mutex> lock(reclaimMutex_);
+
+    auto position = reclaimers_.end();
+    if (consumer == Consumer::ReadAheadCache) {
+        position = std::find_if(reclaimers_.begin(), reclaimers_.end(), [](const std::pair<Consumer, Reclaimer>& r) {
+            return r.first != Consumer::ReadAheadCache;
+        });
+    }
+
+    reclaimers_.emplace(position, consumer, std::move(reclaimer));
+}
+
+void MemoryAccountant::reclaim() {
+    // A single thread reclaims at a time, the others carry on
+    std::unique_lock<std::mutex> lock(reclaimMutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    for (auto& reclaimer : reclaimers_) {
+        size_t pinnedBytes = pinned();
+        if (pinnedBytes <= shedThreshold_) {
+            return;
+        }
+
+        // Each payload byte freed by the consumer unpins more than a byte when its buffers are shared
+        size_t bytes = (size_t) std::ceil((pinnedBytes - shedThreshold_) / pinnedRatio(reclaimer.first));
+        size_t freed = reclaimer.second(bytes);
+        LOG_DEBUG("Reclaimed " << freed << " bytes -- pinned: " << pinned() << " -- limit: " << limit_);
+    }
+}
@@ -0,0 +1,146 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Metrics.h"
+
+/**
+ * Process-wide budget for the memory held by the entries. Each holder of entry buffers charges the payload bytes it
+ * keeps and releases them once the buffers are dropped.
+ *
+ * The payloads received from the network pin more memory than their size: the socket read buffers they share, or the
+ * arena chunks they were copied into. The budget is checked against the pinned memory, estimated by scaling the
+ * payload bytes of the pending adds and of the write cache by the pinned to used ratio of these buffers. The entries
+ * of the read-ahead cache point into the mapped entry logs, they're counted by their size.
+ *
+ * When the usage goes over the shedding threshold, memory is reclaimed from the read-ahead caches first, as their
+ * entries were only speculatively read, then from the flushed entries of the write caches, which can be read again
+ * from the entry logs. When the limit is reached, the new adds are paused or rejected until the usage goes back under
+ * the threshold.
+ *
+ * A single budget is shared by the storage shards, each registering the reclaimers of its own caches.
+ */
+class MemoryAccountant {
+public:
+    enum class Consumer {
+        // Entries received and not yet completed by the journals
+        PendingAdds,
+        WriteCache,
+        ReadAheadCache,
+    };
+
+    static const int NumConsumers = 3;
+
+    /**
+     * Function freeing up to the given number of bytes, returning the number of bytes actually freed
+     */
+    typedef std::function<size_t(size_t bytes)> Reclaimer;
+
+    /**
+     * Function returning the ratio between the memory pinned by the received payloads and their size
+     */
+    typedef std::function<double()> PinnedRatio;
+
+    /**
+     * @param gaugeSuffix appended to the names of the gauges, to tell apart the budgets of the storage shards
+     * @param pinnedRatio overhead of the received payloads, counted by their size when not set
+     */
+    MemoryAccountant(size_t limit, MetricsManager& metricsManager, const std::string& gaugeSuffix = "",
+            PinnedRatio pinnedRatio = nullptr);
+    ~MemoryAccountant();
+
+    void charge(Consumer consumer, size_t bytes) {
+        usage_[(int) consumer] += bytes;
+        used_ += bytes;
+    }
+
+    void release(Consumer consumer, size_t bytes) {
+        usage_[(int) consumer] -= bytes;
+        used_ -= bytes;
+    }
+
+    size_t used() const {
+        return used_;
+    }
+
+    size_t used(Consumer consumer) const {
+        return usage_[(int) consumer];
+    }
+
+    /**
+     * @return the estimate of the memory pinned by the entries, which is checked against the limit
+     */
+    size_t pinned() const;
+
+    /**
+     * @return whether the usage is high enough that the consumers should stop growing and give memory back
+     */
+    bool shouldShed() const {
+        return pinned() > shedThreshold_;
+    }
+
+    /**
+     * @return whether the limit is reached, in which case no new entries should be accepted
+     */
+    bool isExhausted() const {
+        return pinned() >= limit_;
+    }
+
+    /**
+     * Register the reclaimer of a consumer. The reclaimers of the read-ahead caches are invoked first, then the others
+     * in registration order. Each one is asked for the payload bytes of its consumer that would bring the pinned
+     * memory back under the shedding threshold.
+     */
+    void addReclaimer(Consumer consumer, Reclaimer reclaimer);
+
+    /**
+     * Reclaim memory from the consumers until the usage is back under the shedding threshold. Must be called without
+     * holding any of the consumers locks.
+     */
+    void reclaim();
+
+private:
+    /**
+     * @return the memory pinned per payload byte of the consumer
+     */
+    double pinnedRatio(Consumer consumer) const;
+
+    const size_t limit_;
+    const size_t shedThreshold_;
+
+    std::atomic<size_t> used_;
+    std::atomic<size_t> usage_[NumConsumers];
+    const PinnedRatio pinnedRatio_;
+
+    std::mutex reclaimMutex_;
+    std::vector<std::pair<Consumer, Reclaimer>> reclaimers_;
+
+    MetricsManager& metricsManager_;
+    const std::string gaugeSuffix_;
+};
@@ -25,16 +25,26 @@
 #include <folly/json.h>
 #include <folly/ThreadName.h>
 
+#include <algorithm>
+
 DECLARE_LOG_OBJECT();
 
-static const int64_t BucketSize = 100;
+static const int64_t NumBuckets = 10000;
 static const int64_t MinValue = 0;
 static const int64_t MaxValue = microseconds(seconds(1)).count();
 
-Metric::Metric(const std::string& name) :
+// Value samples are stored multiplied by 1000, see Metric::addValueSample()
+static const int64_t ValueScale = 1000;
+
+static int64_t bucketSize(int64_t maxValue) {
+    return std::max<int64_t>(1, maxValue / NumBuckets);
+}
+
+Metric::Metric(const std::string& name, int64_t maxValue) :
         name_(name),
-        histogram_([]() {
-            return new LatencyHistogram(BucketSize, MinValue, MaxValue);
+        maxValue_(maxValue),
+        histogram_([maxValue]() {
+            return new LatencyHistogram(bucketSize(maxValue), MinValue, maxValue);
         }),
         stats_(dynamic::object()) {
 }
@@ -50,7 +60,7 @@ dynamic Metric::getStats() {
 }
 
 void Metric::updateStats(seconds statsPeriod) {
-    LatencyHistogram aggregated(BucketSize, MinValue, MaxValue);
+    LatencyHistogram aggregated(bucketSize(maxValue_), MinValue, maxValue_);
     for (LatencyHistogram& hist : histogram_.accessAllThreads()) {
         aggregated.merge(hist);
         hist.clear();
@@ -92,6 +102,24 @@ MetricsManager::~MetricsManager() {
 }
 
 MetricPtr MetricsManager::createMetric(const std::string& name) {
+    return registerMetric(name, MaxValue);
+}
+
+MetricPtr MetricsManager::createValueMetric(const std::string& name, uint64_t maxValue) {
+    return registerMetric(name, maxValue * ValueScale);
+}
+
+void MetricsManager::registerGauge(const std::string& name, GaugeFunction function) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    gauges_[name] = Gauge { std::move(function), dynamic::object() };
+}
+
+void MetricsManager::removeGauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    gauges_.erase(name);
+}
+
+MetricPtr MetricsManager::registerMetric(const std::string& name, int64_t maxValue) {
     std::lock_guard<std::mutex> lock(mutex_);
     auto it = metrics_.find(name);
     if (it != metrics_.end()) {
@@ -99,7 +127,7 @@ MetricPtr MetricsManager::createMetric(const std::string& name) {
     }
 
     // Insert new metric
-    MetricPtr metric = std::make_shared<Metric>(name);
+    MetricPtr metric = std::make_shared<Metric>(name, maxValue);
     metrics_[name] = metric;
     return metric;
 }
@@ -119,6 +147,12 @@ void MetricsManager::updateStats() {
         LOG_INFO(metric.first << " : " << json::serialize(metric.second->getStats(), opts));
     }
 
+    for (auto& gauge : gauges_) {
+        gauge.second.stats["value"] = gauge.second.function();
+
+        LOG_INFO(gauge.first << " : " << json::serialize(gauge.second.stats, opts));
+    }
+
     // Schedule next stats update
     eventBase_.runAfterDelay(std::bind(&MetricsManager::updateStats, this), milliseconds(statsPeriod_).count());
 }
@@ -134,6 +168,10 @@ std::string MetricsManager::getJsonStatsNoLock(bool formatJson) {
         stats[metric.first] = metric.second->getStats();
     }
 
+    for (auto& gauge : gauges_) {
+        stats[gauge.first] = gauge.second.stats;
+    }
+
     json::serialization_opts opts;
     opts.pretty_formatting = formatJson;
     opts.sort_keys = true;
@@ -21,6 +21,7 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <string>
 #include <map>
 
@@ -60,7 +61,7 @@ typedef std::shared_ptr<Metric> MetricPtr;
 
 class Metric {
 public:
-    Metric(const std::string& name);
+    Metric(const std::string& name, int64_t maxValue);
 
     Timer startTimer();
 
@@ -76,6 +77,7 @@ private:
     void updateStats(seconds statsPeriod);
 
     const std::string name_;
+    const int64_t maxValue_;
 
     class HistogramTag;
     ThreadLocal<LatencyHistogram, HistogramTag> histogram_;
@@ -88,6 +90,8 @@ private:
 
 typedef std::shared_ptr<Metric> MetricPtr;
 
+typedef std::function<double()> GaugeFunction;
+
 class MetricsManager {
 public:
     MetricsManager(seconds statsPeriod);
@@ -95,13 +99,35 @@ public:
 
     MetricPtr createMetric(const std::string& name);
 
+    /**
+     * Create a metric to track the distribution of values (eg: sizes) in the range [0, maxValue], rather than
+     * latencies
+     */
+    MetricPtr createValueMetric(const std::string& name, uint64_t maxValue);
+
+    /**
+     * Register a function sampled once per stats period, to report a current value (eg: a memory usage). The gauge
+     * must be removed before the function becomes invalid.
+     */
+    void registerGauge(const std::string& name, GaugeFunction function);
+
+    void removeGauge(const std::string& name);
+
     std::string getJsonStats(bool formatJson = true);
 
 private:
+    MetricPtr registerMetric(const std::string& name, int64_t maxValue);
+
     void updateStats();
     std::string getJsonStatsNoLock(bool formatJson);
 
+    struct Gauge {
+        GaugeFunction function;
+        dynamic stats;
+    };
+
     std::map<std::string, MetricPtr> metrics_;
+    std::map<std::string, Gauge> gauges_;
     seconds statsPeriod_;
     EventBase eventBase_;
     std::thread statsUpdateThread_;
@@ -0,0 +1,184 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "PayloadArena.h"
+
+#include <folly/Hash.h>
+
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+constexpr size_t PayloadArena::ChunkSize;
+constexpr size_t PayloadArena::MaxCopySize;
+
+// Memory kept alive by the payloads, and size of the payloads, across all the arenas
+static std::atomic<int64_t> pinnedBytes(0);
+static std::atomic<int64_t> usedBytes(0);
+
+// Number of payloads sharing each read buffer, which is only counted in the pinned bytes by the first one. Split in
+// segments, each with its own lock.
+struct SharedBuffers {
+    std::mutex mutex;
+    std::unordered_map<const uint8_t*, int> refCounts;
+};
+
+static const int NumSharedBufferSegments = 16;
+static SharedBuffers sharedBuffers[NumSharedBufferSegments];
+
+static SharedBuffers& sharedBuffersFor(const uint8_t* buffer) {
+    return sharedBuffers[hash::twang_mix64((uint64_t) buffer) % NumSharedBufferSegments];
+}
+
+struct PayloadArena::Chunk {
+    // One reference for each payload, plus one for the arena while it's the current chunk
+    std::atomic<int> refCount;
+    size_t used;
+    char data[ChunkSize];
+};
+
+// Each payload is preceded by its chunk and its size, to update the stats when it's released
+struct PayloadArena::PayloadHeader {
+    Chunk* chunk;
+    size_t size;
+};
+
+PayloadArena::PayloadArena(bool shareLargePayloads) :
+        currentChunk_(nullptr),
+        shareLargePayloads_(shareLargePayloads) {
+}
+
+PayloadArena::~PayloadArena() {
+    if (currentChunk_) {
+        releaseChunk(currentChunk_);
+    }
+}
+
+IOBufPtr PayloadArena::read(io::Cursor& cursor, size_t size) {
+    if (size <= MaxCopySize) {
+        return copy(cursor, size);
+    }
+
+    return shareLargePayloads_ ? clone(cursor, size) : copyLarge(cursor, size);
+}
+
+IOBufPtr PayloadArena::copy(io::Cursor& cursor, size_t size) {
+    // Keep the headers aligned
+    const size_t alignment = alignof(PayloadHeader);
+    size_t allocationSize = (sizeof(PayloadHeader) + size + alignment - 1) & ~(alignment - 1);
+
+    if (!currentChunk_ || currentChunk_->used + allocationSize > ChunkSize) {
+        if (currentChunk_) {
+            releaseChunk(currentChunk_);
+        }
+
+        void* memory = malloc(sizeof(Chunk));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+
+        currentChunk_ = new (memory) Chunk;
+        currentChunk_->refCount = 1;
+        currentChunk_->used = 0;
+        pinnedBytes += sizeof(Chunk);
+    }
+
+    PayloadHeader* header = (PayloadHeader*) (currentChunk_->data + currentChunk_->used);
+    header->chunk = currentChunk_;
+    header->size = size;
+    currentChunk_->used += allocationSize;
+    ++currentChunk_->refCount;
+    usedBytes += size;
+
+    char* payload = (char*) (header + 1);
+    cursor.pull(payload, size);
+
+    return IOBuf::takeOwnership(payload, size, [](void*, void* userData) {
+        PayloadHeader* header = (PayloadHeader*) userData;
+        usedBytes -= header->size;
+        releaseChunk(header->chunk);
+    }, header);
+}
+
+IOBufPtr PayloadArena::clone(io::Cursor& cursor, size_t size) {
+    IOBufPtr data;
+    cursor.clone(data, size);
+
+    // The payload must be contiguous to be wrapped into a single buffer. When it spans multiple read buffers, it
+    // gets copied into a buffer of its own.
+    data->coalesce();
+
+    // The whole read buffer is kept alive by the clone, though it's only counted once for all the payloads in it
+    const uint8_t* buffer = data->buffer();
+    int64_t capacity = data->capacity();
+    {
+        SharedBuffers& shared = sharedBuffersFor(buffer);
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (shared.refCounts[buffer]++ == 0) {
+            pinnedBytes += capacity;
+        }
+    }
+    usedBytes += size;
+
+    struct Holder {
+        IOBufPtr data;
+        const uint8_t* buffer;
+        int64_t capacity;
+        size_t size;
+    };
+
+    void* payload = data->writableData();
+    return IOBuf::takeOwnership(payload, size, [](void*, void* userData) {
+        Holder* holder = (Holder*) userData;
+        {
+            SharedBuffers& shared = sharedBuffersFor(holder->buffer);
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            auto it = shared.refCounts.find(holder->buffer);
+            if (--it->second == 0) {
+                shared.refCounts.erase(it);
+                pinnedBytes -= holder->capacity;
+            }
+        }
+        usedBytes -= holder->size;
+        delete holder;
+    }, new Holder { std::move(data), buffer, capacity, size });
+}
+
+IOBufPtr PayloadArena::copyLarge(io::Cursor& cursor, size_t size) {
+    // The buffer only holds the payload, it doesn't change the pinned to used ratio
+    IOBufPtr data = IOBuf::create(size);
+    cursor.pull(data->writableData(), size);
+    data->append(size);
+    return data;
+}
+
+void PayloadArena::releaseChunk(Chunk* chunk) {
+    if (--chunk->refCount == 0) {
+        pinnedBytes -= sizeof(Chunk);
+        chunk->~Chunk();
+        free(chunk);
+    }
+}
+
+double PayloadArena::pinnedToUsedRatio() {
+    int64_t used = usedBytes;
+    return used == 0 ? 0.0 : (double) pinnedBytes / used;
+}
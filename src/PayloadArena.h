@@ -0,0 +1,81 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+using namespace folly;
+typedef std::unique_ptr<IOBuf> IOBufPtr;
+
+/**
+ * Copies the small payloads received from the network into large chunks, so that an entry waiting in the journal
+ * queue or in the write cache doesn't keep a whole socket read buffer alive. Large payloads are not copied, they
+ * keep sharing the read buffer, unless the buffer is about to be reused.
+ *
+ * A chunk is freed once all the payloads carved from it are released. An arena is used by the thread of a single
+ * connection, while the payloads can be released from any thread.
+ */
+class PayloadArena {
+public:
+    /**
+     * @param shareLargePayloads false when the memory the payloads are read from gets overwritten once read, in
+     * which case the large payloads are copied into buffers of their own
+     */
+    explicit PayloadArena(bool shareLargePayloads = true);
+    ~PayloadArena();
+
+    PayloadArena(const PayloadArena&) = delete;
+    PayloadArena& operator=(const PayloadArena&) = delete;
+
+    /**
+     * Read the next size bytes from the cursor, copying them into the arena if they're small enough
+     */
+    IOBufPtr read(io::Cursor& cursor, size_t size);
+
+    /**
+     * @return the ratio between the memory kept alive by the payloads read through all the arenas, and the size of
+     * these payloads
+     */
+    static double pinnedToUsedRatio();
+
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    // Payloads bigger than this are not copied into the chunks
+    static constexpr size_t MaxCopySize = 4 * 1024;
+
+private:
+    struct Chunk;
+    struct PayloadHeader;
+
+    IOBufPtr copy(io::Cursor& cursor, size_t size);
+    IOBufPtr clone(io::Cursor& cursor, size_t size);
+    IOBufPtr copyLarge(io::Cursor& cursor, size_t size);
+
+    static void releaseChunk(Chunk* chunk);
+
+    Chunk* currentChunk_;
+    const bool shareLargePayloads_;
+};
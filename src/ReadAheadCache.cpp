@@ -0,0 +1,169 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "ReadAheadCache.h"
+
+#include <folly/Hash.h>
+
+#include <algorithm>
+#include <iterator>
+
+const int ReadAheadCache::MinWindow;
+
+ReadAheadCache::ReadAheadCache(size_t maxSize, int maxWindow, MemoryAccountant& memoryAccountant,
+        MetricsManager& metricsManager, const std::string& gaugeSuffix) :
+        maxSize_(maxSize),
+        maxWindow_(std::max(maxWindow, MinWindow)),
+        mutex_(),
+        entries_(),
+        insertionOrder_(),
+        ledgers_(),
+        size_(0),
+        hits_(0),
+        misses_(0),
+        wastedBytes_(0),
+        memoryAccountant_(memoryAccountant),
+        metricsManager_(metricsManager),
+        gaugeSuffix_(gaugeSuffix),
+        prefetchSize_(metricsManager.createValueMetric("readAheadPrefetchSize" + gaugeSuffix_, maxWindow_)) {
+    metricsManager_.registerGauge("readAheadHitRatio" + gaugeSuffix_, [this] {
+        // Ratio over the last stats period
+        uint64_t hits = hits_.exchange(0);
+        uint64_t misses = misses_.exchange(0);
+        return hits + misses == 0 ? 0.0 : (double) hits / (hits + misses);
+    });
+
+    metricsManager_.registerGauge("readAheadWastedBytes" + gaugeSuffix_, [this] {
+        // Prefetched bytes evicted without being read, over the last stats period
+        return (double) wastedBytes_.exchange(0);
+    });
+}
+
+ReadAheadCache::~ReadAheadCache() {
+    metricsManager_.removeGauge("readAheadHitRatio" + gaugeSuffix_);
+    metricsManager_.removeGauge("readAheadWastedBytes" + gaugeSuffix_);
+    memoryAccountant_.release(MemoryAccountant::Consumer::ReadAheadCache, size_);
+}
+
+IOBufPtr ReadAheadCache::get(int64_t ledgerId, int64_t entryId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(Key { ledgerId, entryId });
+    if (it == entries_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+
+    // Readers catching up don't read the same entry twice
+    ++hits_;
+    IOBufPtr data = std::move(it->second.data);
+    size_t entrySize = data->computeChainDataLength();
+    size_ -= entrySize;
+    memoryAccountant_.release(MemoryAccountant::Consumer::ReadAheadCache, entrySize);
+    insertionOrder_.erase(it->second.position);
+    entries_.erase(it);
+    return data;
+}
+
+ReadAheadCache::Prefetch ReadAheadCache::onRead(int64_t ledgerId, int64_t entryId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = ledgers_.find(ledgerId);
+    if (it == ledgers_.end()) {
+        if (ledgers_.size() >= MaxTrackedLedgers) {
+            ledgers_.clear();
+        }
+
+        ledgers_.emplace(ledgerId, LedgerState { entryId, entryId, 0 });
+        return Prefetch { entryId + 1, 0 };
+    }
+
+    LedgerState& state = it->second;
+    bool sequential = entryId == state.lastEntryId + 1;
+    state.lastEntryId = entryId;
+
+    if (!sequential) {
+        state.prefetchedUpTo = entryId;
+        state.window = 0;
+        return Prefetch { entryId + 1, 0 };
+    }
+
+    if (state.window == 0) {
+        state.window = MinWindow;
+    } else if (state.prefetchedUpTo - entryId > state.window / 2) {
+        // Still far enough from the end of the prefetched entries
+        return Prefetch { entryId + 1, 0 };
+    } else {
+        // The reader is keeping up with the prefetching
+        state.window = std::min(state.window * 2, maxWindow_);
+    }
+
+    int64_t firstEntryId = std::max(entryId, state.prefetchedUpTo) + 1;
+    int count = state.window - (int) (firstEntryId - entryId - 1);
+    state.prefetchedUpTo = firstEntryId + count - 1;
+
+    prefetchSize_->addValueSample(count);
+    return Prefetch { firstEntryId, count };
+}
+
+void ReadAheadCache::put(int64_t ledgerId, int64_t entryId, IOBufPtr data) {
+    size_t entrySize = data->computeChainDataLength();
+    Key key { ledgerId, entryId };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(key)) {
+        return;
+    }
+
+    evict(entrySize, maxSize_);
+    if (size_ + entrySize > maxSize_) {
+        return;
+    }
+
+    insertionOrder_.push_back(key);
+    entries_.emplace(key, CachedEntry { std::move(data), std::prev(insertionOrder_.end()) });
+    size_ += entrySize;
+    memoryAccountant_.charge(MemoryAccountant::Consumer::ReadAheadCache, entrySize);
+}
+
+size_t ReadAheadCache::shrink(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t sizeBefore = size_;
+    evict(0, sizeBefore > bytes ? sizeBefore - bytes : 0);
+    return sizeBefore - size_;
+}
+
+void ReadAheadCache::evict(size_t requiredSize, size_t maxSize) {
+    // The entries already read are not in the insertion order anymore
+    while (size_ + requiredSize > maxSize && !insertionOrder_.empty()) {
+        auto it = entries_.find(insertionOrder_.front());
+        insertionOrder_.pop_front();
+
+        size_t entrySize = it->second.data->computeChainDataLength();
+        size_ -= entrySize;
+        wastedBytes_ += entrySize;
+        memoryAccountant_.release(MemoryAccountant::Consumer::ReadAheadCache, entrySize);
+        entries_.erase(it);
+    }
+}
+
+size_t ReadAheadCache::KeyHash::operator()(const Key& key) const {
+    return hash::hash_128_to_64(hash::twang_mix64(key.ledgerId), hash::twang_mix64(key.entryId));
+}
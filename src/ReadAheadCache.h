@@ -0,0 +1,135 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "MemoryAccountant.h"
+#include "Metrics.h"
+
+using folly::IOBuf;
+typedef std::unique_ptr<IOBuf> IOBufPtr;
+
+/**
+ * Detects the ledgers being read sequentially and keeps the entries prefetched for them.
+ *
+ * The read-ahead window of a ledger starts small once 2 consecutive entries are read, then doubles every time the
+ * reader gets to the prefetched entries, up to the max window. It's reset when the reader jumps elsewhere.
+ *
+ * Prefetched entries are dropped once read, or in insertion order when the cache is full.
+ */
+class ReadAheadCache {
+public:
+    /**
+     * @param gaugeSuffix appended to the names of the gauges, to tell apart the caches of the storage shards
+     */
+    ReadAheadCache(size_t maxSize, int maxWindow, MemoryAccountant& memoryAccountant,
+            MetricsManager& metricsManager, const std::string& gaugeSuffix = "");
+    ~ReadAheadCache();
+
+    struct Prefetch {
+        int64_t firstEntryId;
+        int count;
+    };
+
+    /**
+     * Take a prefetched entry out of the cache
+     *
+     * @return nullptr if the entry was not prefetched
+     */
+    IOBufPtr get(int64_t ledgerId, int64_t entryId);
+
+    /**
+     * Track a read of the ledger and tell which entries should be prefetched after it, if any
+     */
+    Prefetch onRead(int64_t ledgerId, int64_t entryId);
+
+    void put(int64_t ledgerId, int64_t entryId, IOBufPtr data);
+
+    /**
+     * Drop the oldest prefetched entries to free up memory
+     *
+     * @return the number of bytes freed
+     */
+    size_t shrink(size_t bytes);
+
+private:
+    struct Key {
+        int64_t ledgerId;
+        int64_t entryId;
+
+        bool operator==(const Key& other) const {
+            return ledgerId == other.ledgerId && entryId == other.entryId;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct CachedEntry {
+        IOBufPtr data;
+
+        // Position of the entry in the insertion order, to unlink it when it's read
+        std::list<Key>::iterator position;
+    };
+
+    struct LedgerState {
+        int64_t lastEntryId;
+
+        // Last entry that was already requested for prefetching
+        int64_t prefetchedUpTo;
+        int window;
+    };
+
+    void evict(size_t requiredSize, size_t maxSize);
+
+    static const int MinWindow = 16;
+
+    // Max number of ledgers for which the read pattern is tracked
+    static const size_t MaxTrackedLedgers = 10000;
+
+    const size_t maxSize_;
+    const int maxWindow_;
+
+    std::mutex mutex_;
+    std::unordered_map<Key, CachedEntry, KeyHash> entries_;
+    std::list<Key> insertionOrder_;
+    std::unordered_map<int64_t, LedgerState> ledgers_;
+    size_t size_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> wastedBytes_;
+
+    MemoryAccountant& memoryAccountant_;
+    MetricsManager& metricsManager_;
+    const std::string gaugeSuffix_;
+    MetricPtr prefetchSize_;
+};
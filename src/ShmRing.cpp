@@ -0,0 +1,249 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "ShmRing.h"
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace folly;
+
+struct ShmRing::Header {
+    // Written by the producer
+    alignas(64) std::atomic<uint64_t> writeIndex;
+
+    // Written by the consumer
+    alignas(64) std::atomic<uint64_t> readIndex;
+    alignas(64) std::atomic<uint32_t> consumerWaiting;
+};
+
+// Left by the producer where a frame didn't fit before the end of the ring. It reads the same in both byte orders.
+static const uint32_t WrapMarker = 0xFFFFFFFF;
+
+// Keeps the length fields aligned, and leaves room for a wrap marker at the end of the ring
+static const size_t RecordAlignment = 8;
+
+ShmRing::ShmRing(Header* header, size_t capacity) :
+        header_(header),
+        data_((uint8_t*) (header + 1)),
+        capacity_(capacity) {
+}
+
+size_t ShmRing::memorySize(size_t capacity) {
+    return sizeof(Header) + capacity;
+}
+
+void ShmRing::initialize(Header* header) {
+    new (header) Header();
+    header->writeIndex = 0;
+    header->readIndex = 0;
+    header->consumerWaiting = 1;
+}
+
+size_t ShmRing::recordSize(size_t size) {
+    return (size + RecordAlignment - 1) & ~(RecordAlignment - 1);
+}
+
+uint8_t* ShmRing::reserve(size_t size) {
+    size_t record = recordSize(size);
+    uint64_t write = header_->writeIndex.load(std::memory_order_relaxed);
+    uint64_t read = header_->readIndex.load(std::memory_order_acquire);
+
+    size_t offset = write % capacity_;
+    size_t tail = capacity_ - offset;
+    size_t needed = record > tail ? tail + record : record;
+    if (record > capacity_ || capacity_ - (write - read) < needed) {
+        return nullptr;
+    }
+
+    if (record > tail) {
+        // The frame goes at the start of the ring, the consumer skips the rest
+        *(uint32_t*) (data_ + offset) = WrapMarker;
+        header_->writeIndex.store(write + tail, std::memory_order_release);
+        offset = 0;
+    }
+
+    return data_ + offset;
+}
+
+bool ShmRing::commit(size_t size) {
+    uint64_t write = header_->writeIndex.load(std::memory_order_relaxed);
+    header_->writeIndex.store(write + recordSize(size), std::memory_order_seq_cst);
+
+    // Pairs with prepareToWait: either the consumer sees the frame before sleeping, or it's seen asleep here
+    return header_->consumerWaiting.load(std::memory_order_seq_cst) != 0
+            && header_->consumerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+const uint8_t* ShmRing::peek(size_t& size) {
+    uint64_t read = header_->readIndex.load(std::memory_order_relaxed);
+
+    while (true) {
+        uint64_t write = header_->writeIndex.load(std::memory_order_acquire);
+        if (read == write) {
+            return nullptr;
+        }
+
+        size_t offset = read % capacity_;
+        uint32_t length = Endian::big(*(const uint32_t*) (data_ + offset));
+        if (length == WrapMarker) {
+            read += capacity_ - offset;
+            header_->readIndex.store(read, std::memory_order_release);
+            continue;
+        }
+
+        // The other process is not trusted to keep the ring consistent
+        size = sizeof(int32_t) + (size_t) length;
+        if (size > write - read || size > capacity_ - offset) {
+            throw std::runtime_error("Corrupted shared memory ring");
+        }
+
+        return data_ + offset;
+    }
+}
+
+void ShmRing::consume(size_t size) {
+    uint64_t read = header_->readIndex.load(std::memory_order_relaxed);
+    header_->readIndex.store(read + recordSize(size), std::memory_order_release);
+}
+
+bool ShmRing::prepareToWait() {
+    header_->consumerWaiting.store(1, std::memory_order_seq_cst);
+
+    uint64_t read = header_->readIndex.load(std::memory_order_relaxed);
+    if (header_->writeIndex.load(std::memory_order_seq_cst) != read) {
+        // At worst, the producer rings a doorbell nobody waits for
+        header_->consumerWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+// Start of the segment, followed by the request ring and the response ring
+struct SegmentHeader {
+    alignas(64) uint64_t magic;
+    uint64_t ringCapacity;
+};
+
+static const uint64_t SegmentMagic = 0x626f6f6b69652d31; // "bookie-1"
+
+static size_t segmentSize(size_t ringCapacity) {
+    return sizeof(SegmentHeader) + 2 * ShmRing::memorySize(ringCapacity);
+}
+
+static ShmRing::Header* ringHeader(void* memory, size_t ringCapacity, int index) {
+    uint8_t* rings = (uint8_t*) memory + sizeof(SegmentHeader);
+    return (ShmRing::Header*) (rings + index * ShmRing::memorySize(ringCapacity));
+}
+
+ShmChannel::ShmChannel(const std::string& name, void* memory, size_t size, size_t ringCapacity) :
+        name_(name),
+        linked_(true),
+        memory_(memory),
+        size_(size),
+        requests_(ringHeader(memory, ringCapacity, 0), ringCapacity),
+        responses_(ringHeader(memory, ringCapacity, 1), ringCapacity) {
+}
+
+ShmChannel::~ShmChannel() {
+    unlink();
+    munmap(memory_, size_);
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::create(const std::string& name, size_t ringCapacity) {
+    // Keep the second ring on its own cache lines
+    ringCapacity = (ringCapacity + 63) & ~size_t(63);
+    size_t size = segmentSize(ringCapacity);
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        throwSystemError("Failed to create shared memory segment ", name);
+    }
+
+    if (ftruncate(fd, size) != 0) {
+        int error = errno;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throwSystemErrorExplicit(error, "Failed to resize shared memory segment ", name);
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throwSystemErrorExplicit(error, "Failed to map shared memory segment ", name);
+    }
+
+    SegmentHeader* header = new (memory) SegmentHeader;
+    header->magic = SegmentMagic;
+    header->ringCapacity = ringCapacity;
+    ShmRing::initialize(ringHeader(memory, ringCapacity, 0));
+    ShmRing::initialize(ringHeader(memory, ringCapacity, 1));
+
+    return std::unique_ptr<ShmChannel>(new ShmChannel(name, memory, size, ringCapacity));
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::open(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throwSystemError("Failed to open shared memory segment ", name);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SegmentHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Invalid shared memory segment " + name);
+    }
+
+    size_t size = st.st_size;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        throwSystemErrorExplicit(error, "Failed to map shared memory segment ", name);
+    }
+
+    const SegmentHeader* header = (const SegmentHeader*) memory;
+    size_t ringCapacity = header->ringCapacity;
+    if (header->magic != SegmentMagic || ringCapacity % RecordAlignment != 0 || segmentSize(ringCapacity) != size) {
+        munmap(memory, size);
+        throw std::runtime_error("Invalid shared memory segment " + name);
+    }
+
+    return std::unique_ptr<ShmChannel>(new ShmChannel(name, memory, size, ringCapacity));
+}
+
+void ShmChannel::unlink() {
+    if (linked_) {
+        // The other side may have unlinked it already
+        shm_unlink(name_.c_str());
+        linked_ = false;
+    }
+}
@@ -0,0 +1,146 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Single-producer single-consumer ring of frames, in memory shared by two processes. The frames are in the V2 wire
+ * format, starting with their length field, and each frame is contiguous in the ring: when it doesn't fit before the
+ * end of the ring, the producer leaves a wrap marker and writes it at the start.
+ *
+ * The consumer can go to sleep when the ring is empty. The producer then rings its doorbell after the next frame,
+ * through a channel of its choice, while a consumer that keeps up never needs one.
+ */
+class ShmRing {
+public:
+    struct Header;
+
+    /**
+     * @param header shared header, followed by the capacity bytes of the ring
+     */
+    ShmRing(Header* header, size_t capacity);
+
+    /**
+     * @return the memory needed by a ring, header included
+     */
+    static size_t memorySize(size_t capacity);
+
+    /**
+     * Reset a ring that nobody uses yet. The consumer is considered asleep.
+     */
+    static void initialize(Header* header);
+
+    /**
+     * Producer: get contiguous room for a frame of the given size, length field included
+     *
+     * @return nullptr if the ring is too full
+     */
+    uint8_t* reserve(size_t size);
+
+    /**
+     * Producer: publish the frame written in the reserved room
+     *
+     * @return true if the consumer is asleep and its doorbell must be rung
+     */
+    bool commit(size_t size);
+
+    /**
+     * Consumer: get the next frame, length field included, without removing it
+     *
+     * @return nullptr if the ring is empty
+     */
+    const uint8_t* peek(size_t& size);
+
+    /**
+     * Consumer: release the frame returned by peek, so that its room can be reused
+     */
+    void consume(size_t size);
+
+    /**
+     * Consumer: announce that it's going to sleep until the doorbell rings
+     *
+     * @return false if frames were published meanwhile, in which case it must not sleep
+     */
+    bool prepareToWait();
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    static size_t recordSize(size_t size);
+
+    Header* header_;
+    uint8_t* data_;
+    const size_t capacity_;
+};
+
+/**
+ * A shared memory segment holding the request and the response rings of a local client. The segment is created by
+ * the bookie, and the client maps it by name. The name is unlinked once both sides have mapped it, or when the
+ * connection is closed.
+ */
+class ShmChannel {
+public:
+    ~ShmChannel();
+
+    /**
+     * Create a segment with two rings of the given capacity
+     */
+    static std::unique_ptr<ShmChannel> create(const std::string& name, size_t ringCapacity);
+
+    /**
+     * Map a segment created by the bookie
+     */
+    static std::unique_ptr<ShmChannel> open(const std::string& name);
+
+    /**
+     * Remove the name of the segment. It stays mapped until both sides are done with it.
+     */
+    void unlink();
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    ShmRing& requests() {
+        return requests_;
+    }
+
+    ShmRing& responses() {
+        return responses_;
+    }
+
+private:
+    ShmChannel(const std::string& name, void* memory, size_t size, size_t ringCapacity);
+
+    const std::string name_;
+    bool linked_;
+    void* memory_;
+    const size_t size_;
+    ShmRing requests_;
+    ShmRing responses_;
+};
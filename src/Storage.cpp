@@ -18,15 +18,24 @@
  * under the License.
  *
  */
+#include "BookieProtocol.h"
+#include "CpuAffinity.h"
 #include "Logging.h"
+#include "PayloadArena.h"
 #include "RateLimiter.h"
 #include "Storage.h"
 
 #include <chrono>
+#include <limits>
+#include <unordered_map>
 #include <rocksdb/table.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/cache.h>
 #include <rocksdb/slice_transform.h>
+#include <boost/filesystem.hpp>
+#include <folly/Bits.h>
+#include <folly/Conv.h>
+#include <folly/Hash.h>
 #include <folly/ThreadName.h>
 
 using namespace rocksdb;
@@ -46,19 +55,112 @@ constexpr unsigned long long int operator ""_GB(unsigned long long int gigabytes
     return gigabytes * 1024 * 1024 * 1024;
 }
 
-Storage::Storage(const BookieConfig& conf, MetricsManager& metricsManager) :
+/**
+ * Directory of a storage shard, under the configured one
+ */
+static std::string shardDirectory(const std::string& directory, int shardId) {
+    return shardId < 0 ? directory : to<std::string>(directory, "/shard-", shardId);
+}
+
+/**
+ * Share of a cache size or queue limit given to a storage shard
+ */
+static size_t shardLimit(size_t limit, const BookieConfig& conf, int shardId) {
+    return shardId < 0 ? limit : limit / conf.numShards();
+}
+
+Storage::Storage(const BookieConfig& conf, MetricsManager& metricsManager, int shardId,
+        MemoryAccountant* sharedMemoryAccountant) :
+        gaugeSuffix_(shardId < 0 ? "" : to<std::string>("-shard-", shardId)),
         db_(nullptr),
+        ledgersColumnFamily_(nullptr),
+        ledgersMetadataComplete_(false),
         writeOptions_(),
-        journalQueue_(10000),
-        fsyncWal_(conf.fsyncWal()),
-        journalThread_(std::bind(&Storage::runJournal, this)),
+        readOptions_(),
+        entryLogger_(),
+        ownMemoryAccountant_(sharedMemoryAccountant ? nullptr :
+                new MemoryAccountant(conf.memoryLimit(), metricsManager, gaugeSuffix_,
+                        &PayloadArena::pinnedToUsedRatio)),
+        memoryAccountant_(sharedMemoryAccountant ? *sharedMemoryAccountant : *ownMemoryAccountant_),
+        writeCache_(),
+        readAheadCache_(),
+        prefetchExecutor_(),
+        journals_(),
+        checkpointInterval_(conf.checkpointInterval()),
+        checkpointMutex_(),
+        checkpointCondition_(),
+        stopping_(false),
+        checkpointThread_(),
+        ledgerDirectory_(std::bind(&Storage::loadLedgerInfo, this, std::placeholders::_1)),
+        startupSnapshot_(nullptr),
+        metricsManager_(metricsManager),
+        maxPendingAddEntries_(shardLimit(conf.maxPendingAddEntries(), conf, shardId)),
+        maxPendingAddBytes_(shardLimit(conf.maxPendingAddBytes(), conf, shardId)),
+        pendingAddEntries_(0),
+        pendingAddBytes_(0),
         rocksDbPutLatency_(metricsManager.createMetric("rocksDbPut")),
-        addEntryEnqueueLatency_(metricsManager.createMetric("addEntryEnqueueLatency")),
-        walSyncLatency_(metricsManager.createMetric("walSync")),
-        walQueueLatency_(metricsManager.createMetric("walQueueLatency")) {
+        checkpointLatency_(metricsManager.createMetric("checkpoint")),
+        indexLookupLatency_(metricsManager.createMetric("indexLookup")) {
+    std::vector<int> storageCpus = CpuAffinity::threadCpus(conf.storageThreadsCpus(), conf.numaNode());
+    std::string dataDirectory = shardDirectory(conf.dataDirectory(), shardId);
+    openDatabase(dataDirectory + "/index", storageCpus, shardId < 0 ? 1 : conf.numShards());
+
+    entryLogger_.reset(new EntryLogger(dataDirectory + "/entrylogs", conf.entryLogMaxSize()));
+
+    size_t writeCacheMaxSize = shardLimit(conf.writeCacheMaxSize(), conf, shardId);
+    if (writeCacheMaxSize > 0) {
+        writeCache_.reset(new WriteCache(writeCacheMaxSize, memoryAccountant_, metricsManager, gaugeSuffix_));
+    }
+
+    size_t readAheadCacheMaxSize = shardLimit(conf.readAheadCacheMaxSize(), conf, shardId);
+    if (readAheadCacheMaxSize > 0) {
+        readAheadCache_.reset(
+                new ReadAheadCache(readAheadCacheMaxSize, conf.readAheadMaxEntries(), memoryAccountant_,
+                        metricsManager, gaugeSuffix_));
+        prefetchExecutor_.reset(
+                new wangle::CPUThreadPoolExecutor(1, std::make_shared<PinnedThreadFactory>("bookie-prefetch",
+                        storageCpus)));
+    }
+
+    // Under memory pressure, drop the prefetched entries first, then the entries already in the ledger storage
+    if (readAheadCache_) {
+        memoryAccountant_.addReclaimer(MemoryAccountant::Consumer::ReadAheadCache,
+                std::bind(&ReadAheadCache::shrink, readAheadCache_.get(), std::placeholders::_1));
+    }
+
+    if (writeCache_) {
+        memoryAccountant_.addReclaimer(MemoryAccountant::Consumer::WriteCache,
+                std::bind(&WriteCache::shrink, writeCache_.get(), std::placeholders::_1));
+    }
+
+    LOG_INFO("Starting " << conf.numJournals() << " journal threads");
+    // The journals of all the shards share the journal directory, each with its own id
+    int firstJournalId = shardId < 0 ? 0 : shardId * conf.numJournals();
+    for (int i = 0; i < conf.numJournals(); i++) {
+        journals_.emplace_back(new Journal(firstJournalId + i, *this, conf, metricsManager));
+    }
+
+    // The ledger directory loads the ledgers written before this point from the index
+    startupSnapshot_ = db_->GetSnapshot();
+
+    metricsManager_.registerGauge("pendingAddEntries" + gaugeSuffix_, [this] {
+        return (double) pendingAddEntries_;
+    });
+
+    checkpointThread_ = std::thread([this, storageCpus] {
+        CpuAffinity::pinCurrentThread(storageCpus);
+        runCheckpoint();
+    });
+}
+
+void Storage::openDatabase(const std::string& indexDirectory, const std::vector<int>& cpus, int numShards) {
+    // The RocksDB background threads are started from here and inherit the CPU affinity
+    ScopedCpuAffinity affinity(cpus);
+
     Options options;
     options.create_if_missing = true;
-    options.write_buffer_size = 1_GB;
+    // The shards split the memtables and the block cache memory
+    options.write_buffer_size = 1_GB / numShards;
     options.max_write_buffer_number = 4;
     options.max_background_compactions = 16;
     options.max_background_flushes = 4;
@@ -71,6 +173,9 @@ Storage::Storage(const BookieConfig& conf, MetricsManager& metricsManager) :
     options.compaction_readahead_size = 8_MB;
     options.allow_concurrent_memtable_write = true;
 
+    // The index WAL is flushed and synced by the checkpoint, until then the entries can be recovered from the journal
+    options.manual_wal_flush = true;
+
     // Keys are always 16 bytes (ledgerId, entryId)
     options.prefix_extractor.reset(NewFixedPrefixTransform(8));
 
@@ -78,125 +183,512 @@ Storage::Storage(const BookieConfig& conf, MetricsManager& metricsManager) :
     options.keep_log_file_num = 30;
     options.stats_dump_period_sec = 60;
 
-    options.wal_dir = conf.walDirectory();
-
     BlockBasedTableOptions table_options;
     table_options.block_size = 256_KB;
     table_options.format_version = 2;
     table_options.checksum = kxxHash;
-    table_options.block_cache = NewLRUCache(8_GB, 8);
+    table_options.block_cache = NewLRUCache(8_GB / numShards, 8);
     table_options.cache_index_and_filter_blocks = true;
     table_options.filter_policy.reset(NewBloomFilterPolicy(10, false));
     options.table_factory.reset(NewBlockBasedTableFactory(table_options));
 
-    LOG_INFO("Opening database at " << conf.dataDirectory());
+    // The ledgers metadata is keyed by ledgerId only
+    ColumnFamilyOptions ledgersOptions(options);
+    ledgersOptions.prefix_extractor.reset();
+
+    options.create_missing_column_families = true;
+    std::vector<ColumnFamilyDescriptor> columnFamilies = { ColumnFamilyDescriptor(kDefaultColumnFamilyName, options),
+            ColumnFamilyDescriptor("ledgers", ledgersOptions) };
+    std::vector<ColumnFamilyHandle*> handles;
 
-    Status res = DB::Open(options, conf.dataDirectory(), &db_);
+    boost::filesystem::create_directories(indexDirectory);
+    LOG_INFO("Opening database at " << indexDirectory);
+
+    Status res = DB::Open(options, indexDirectory, columnFamilies, &handles, &db_);
     if (!res.ok()) {
         LOG_FATAL("Failed to open database: " << res.code());
         std::exit(1);
     }
 
+    // The handle of the default column family is owned by the database
+    ledgersColumnFamily_ = handles[1];
+
+    // An empty key marks the indexes that have the metadata of all their ledgers, which is the case when the
+    // metadata is stored from the start
+    std::string marker;
+    ledgersMetadataComplete_ = db_->Get(ReadOptions(), ledgersColumnFamily_, Slice(), &marker).ok();
+    if (!ledgersMetadataComplete_) {
+        ReadOptions readOptions;
+        readOptions.total_order_seek = true;
+        std::unique_ptr<Iterator> it(db_->NewIterator(readOptions));
+        it->SeekToFirst();
+
+        if (!it->Valid() && it->status().ok()) {
+            res = db_->Put(writeOptions_, ledgersColumnFamily_, Slice(), Slice());
+            if (res.ok()) {
+                res = db_->FlushWAL(true);
+            }
+
+            if (!res.ok()) {
+                LOG_FATAL("Failed to initialize the ledgers metadata: " << res.ToString());
+                std::exit(1);
+            }
+
+            ledgersMetadataComplete_ = true;
+        } else {
+            LOG_WARN("The index has no metadata for the ledgers written by previous versions, looking them up in "
+                    "the index instead");
+        }
+    }
+
     LOG_INFO("Database opened successfully");
 }
 
 Storage::~Storage() {
-    // Write a null promise to make the journal thread to exit
-    JournalEntry entry { { }, { }, nullptr, walQueueLatency_->startTimer() };
-    journalQueue_.blockingWrite(std::move(entry));
-    journalThread_.join();
+    metricsManager_.removeGauge("pendingAddEntries" + gaugeSuffix_);
+
+    // The pending prefetches are dropped
+    if (prefetchExecutor_) {
+        prefetchExecutor_->stop();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex_);
+        stopping_ = true;
+    }
+    checkpointCondition_.notify_all();
+    checkpointThread_.join();
+
+    // Stop the journal threads before closing the database. Entries written after the last checkpoint will be
+    // replayed from the journal at the next startup.
+    journals_.clear();
+    db_->ReleaseSnapshot(startupSnapshot_);
+    delete ledgersColumnFamily_;
     delete db_;
 }
 
-Future<Unit> Storage::put(int64_t ledgerId, int64_t entryId, IOBufPtr data) {
-    PromisePtr promise = make_unique<Promise<Unit>>();
-    Future<Unit> future = promise->getFuture();
+bool Storage::put(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion) {
+    if (memoryAccountant_.shouldShed()) {
+        memoryAccountant_.reclaim();
+    }
 
-    union Key {
-        struct {
-            int64_t ledgerId;
-            int64_t entryId;
-        };
-        char data[0];
-    };
+    size_t size = data->computeChainDataLength();
+    pendingAddEntries_ += 1;
+    pendingAddBytes_ += size;
+    memoryAccountant_.charge(MemoryAccountant::Consumer::PendingAdds, size);
+
+    if (writeCache_) {
+        writeCache_->put(ledgerId, entryId, *data);
+    }
 
-    Key key;
-    key.ledgerId = Endian::big(ledgerId);
-    key.entryId = Endian::big(entryId);
+    if (!journalForLedger(ledgerId).append(ledgerId, entryId, std::move(data), std::move(completion))) {
+        pendingAddEntries_ -= 1;
+        pendingAddBytes_ -= size;
+        memoryAccountant_.release(MemoryAccountant::Consumer::PendingAdds, size);
 
-    JournalEntry entry { Slice(key.data, sizeof(key)), std::move(data), std::move(promise),
-            walQueueLatency_->startTimer() };
+        if (writeCache_) {
+            writeCache_->remove(ledgerId, entryId);
+        }
+        return false;
+    }
 
-    Slice valueSlice((const char*) data->data(), data->length());
+    return true;
+}
 
-    Timer addEntryEnqueueTimer = addEntryEnqueueLatency_->startTimer();
-    journalQueue_.blockingWrite(std::move(entry));
-    addEntryEnqueueTimer.completed();
+bool Storage::isOverloaded() const {
+    return pendingAddEntries_ >= maxPendingAddEntries_
+            || pendingAddBytes_ >= maxPendingAddBytes_
+            || memoryAccountant_.isExhausted();
+}
 
-    return future;
+bool Storage::canResumeAdds() const {
+    // Wait for half of the backlog to drain, to not flip between paused and resumed on every entry
+    return pendingAddEntries_ < maxPendingAddEntries_ / 2
+            && pendingAddBytes_ < maxPendingAddBytes_ / 2
+            && !memoryAccountant_.shouldShed();
 }
 
-void Storage::runJournal() {
-    setThreadName("bookie-journal");
+Future<std::vector<AddStatus>> Storage::putEntries(std::vector<LogEntry> entries) {
+    // Split the entries by journal, remembering their position in the request
+    std::vector<std::vector<LogEntry>> journalEntries(journals_.size());
+    std::vector<std::vector<size_t>> journalIndexes(journals_.size());
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t size = entries[i].data->computeChainDataLength();
+        pendingAddEntries_ += 1;
+        pendingAddBytes_ += size;
+        memoryAccountant_.charge(MemoryAccountant::Consumer::PendingAdds, size);
 
-    std::vector<PromisePtr> entriesToSync;
-    Unit unit;
-    Metric* journalSyncLatency = walSyncLatency_.get();
-    WriteOptions syncOptions;
-    syncOptions.sync = fsyncWal_;
-    WriteBatch writeBatch;
+        if (writeCache_) {
+            writeCache_->put(entries[i].ledgerId, entries[i].entryId, *entries[i].data);
+        }
 
-    JournalEntry entry;
-    bool blockForNextEntry = false;
+        size_t journal = journalIndex(entries[i].ledgerId);
+        journalEntries[journal].emplace_back(std::move(entries[i]));
+        journalIndexes[journal].push_back(i);
+    }
 
-    while (true) {
-        // Collect all items from queue
-        int toSyncCount = 0;
+    std::vector<Future<Unit>> futures;
+    std::vector<size_t> journals;
+    for (size_t journal = 0; journal < journals_.size(); journal++) {
+        if (!journalEntries[journal].empty()) {
+            futures.push_back(journals_[journal]->appendBatch(std::move(journalEntries[journal])));
+            journals.push_back(journal);
+        }
+    }
 
-        while (true) {
-            if (blockForNextEntry) {
-                journalQueue_.blockingRead(entry);
-                blockForNextEntry = false;
-            } else {
-                if (!journalQueue_.read(entry)) {
-                    blockForNextEntry = true;
-                    if (toSyncCount == 0) {
-                        // Block until new entry is available
-                        continue;
-                    } else {
-                        // Queue is drained, write entries to db
-                        break;
+    size_t count = entries.size();
+    return collectAll(futures).then(
+            [count, journals = std::move(journals), journalIndexes = std::move(journalIndexes)](
+                    const std::vector<Try<Unit>>& results) {
+                std::vector<AddStatus> statuses(count, AddStatus::Persisted);
+
+                for (size_t i = 0; i < results.size(); i++) {
+                    if (results[i].hasException()) {
+                        for (size_t index : journalIndexes[journals[i]]) {
+                            statuses[index] = AddStatus::Failed;
+                        }
                     }
                 }
-            }
 
-            if (entry.promise.get() == nullptr) {
-                // Journal is exiting
-                return;
-            }
+                return statuses;
+            });
+}
 
-            entry.walTimeSpentInQueue.completed();
-            entriesToSync.emplace_back(std::move(entry.promise));
-            writeBatch.Put(entry.key, Slice((const char*) entry.data->data(), entry.data->length()));
+void Storage::addEntries(const std::vector<LogEntry>& entries) {
+    // Reused by each journal thread across batches, to not allocate them every time
+    static thread_local std::vector<EntryLocation> locations;
+    static thread_local WriteBatch batch;
+    locations.clear();
+    batch.Clear();
+
+    entryLogger_->addEntries(entries, locations);
+
+    // Keys are always 16 bytes (ledgerId, entryId), big-endian so that entries are sorted within a ledger
+    int64_t key[2];
+
+    // Values are (logId, offset, payload length)
+    int64_t value[3];
+
+    // Metadata of the ledgers in the batch. Each ledger goes to a single journal, so there are no concurrent updates.
+    static thread_local std::unordered_map<int64_t, LedgerInfo> ledgers;
+    ledgers.clear();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t length = entries[i].data->computeChainDataLength();
+        key[0] = Endian::big(entries[i].ledgerId);
+        key[1] = Endian::big(entries[i].entryId);
+        value[0] = Endian::big((int64_t) locations[i].logId);
+        value[1] = Endian::big((int64_t) locations[i].offset);
+        value[2] = Endian::big((int64_t) length);
+        batch.Put(Slice((const char*) key, sizeof(key)), Slice((const char*) value, sizeof(value)));
+
+        auto it = ledgers.find(entries[i].ledgerId);
+        if (it == ledgers.end()) {
+            it = ledgers.emplace(entries[i].ledgerId, storedLedgerInfo(entries[i].ledgerId, nullptr)).first;
+        }
 
-            if (toSyncCount++ == 1000) {
-                break;
+        // Like in the ledger directory, an entry that is not after the last one is a retry, not counted again
+        LedgerInfo& info = it->second;
+        if (entries[i].entryId > info.lastEntryId) {
+            info.lastEntryId = entries[i].entryId;
+            info.entryCount += 1;
+            info.size += length;
+        }
+    }
+
+    for (const auto& ledger : ledgers) {
+        int64_t ledgerKey = Endian::big(ledger.first);
+        value[0] = Endian::big(ledger.second.lastEntryId);
+        value[1] = Endian::big(ledger.second.entryCount);
+        value[2] = Endian::big(ledger.second.size);
+        batch.Put(ledgersColumnFamily_, Slice((const char*) &ledgerKey, sizeof(ledgerKey)),
+                Slice((const char*) value, sizeof(value)));
+    }
+
+    Status res = db_->Write(writeOptions_, &batch);
+    if (!res.ok()) {
+        throw std::runtime_error("Failed to update index: " + res.ToString());
+    }
+
+    if (writeCache_) {
+        writeCache_->markFlushed(entries);
+    }
+}
+
+IOBufPtr Storage::get(int64_t ledgerId, int64_t entryId) {
+    if (writeCache_) {
+        IOBufPtr data = writeCache_->get(ledgerId, entryId);
+        if (data) {
+            return data;
+        }
+    }
+
+    if (!readAheadCache_) {
+        return readEntry(ledgerId, entryId);
+    }
+
+    IOBufPtr data = readAheadCache_->get(ledgerId, entryId);
+    ReadAheadCache::Prefetch prefetch = readAheadCache_->onRead(ledgerId, entryId);
+
+    if (!data) {
+        data = readEntry(ledgerId, entryId);
+    }
+
+    // Don't read ahead when the memory is needed elsewhere
+    if (data && prefetch.count > 0 && !memoryAccountant_.shouldShed()) {
+        prefetchExecutor_->add([this, ledgerId, prefetch] {
+            try {
+                prefetchEntries(ledgerId, prefetch);
+            } catch (const std::exception& e) {
+                LOG_WARN("Failed to prefetch entries of ledger " << ledgerId << ": " << e.what());
             }
+        });
+    }
+
+    return data;
+}
+
+void Storage::prefetchEntries(int64_t ledgerId, ReadAheadCache::Prefetch prefetch) {
+    int64_t key[2] = { Endian::big(ledgerId), Endian::big(prefetch.firstEntryId) };
+
+    // Scan the index of the ledger with a single iterator
+    ReadOptions readOptions;
+    readOptions.prefix_same_as_start = true;
+    std::unique_ptr<Iterator> it(db_->NewIterator(readOptions));
+
+    int count = 0;
+    for (it->Seek(Slice((const char*) key, sizeof(key))); it->Valid() && count < prefetch.count; it->Next()) {
+        const int64_t* entryKey = (const int64_t*) it->key().data();
+        const int64_t* location = (const int64_t*) it->value().data();
+        int64_t entryId = Endian::big(entryKey[1]);
+
+        readAheadCache_->put(ledgerId, entryId,
+                entryLogger_->readEntry(ledgerId, entryId,
+                        EntryLocation { (uint32_t) Endian::big(location[0]), (uint64_t) Endian::big(location[1]) },
+                        true));
+        ++count;
+    }
+
+    if (!it->status().ok()) {
+        throw std::runtime_error("Failed to read index: " + it->status().ToString());
+    }
+}
+
+IOBufPtr Storage::readEntry(int64_t ledgerId, int64_t entryId) {
+    int64_t key[2] = { Endian::big(ledgerId), Endian::big(entryId) };
+
+    Timer indexLookupTimer = indexLookupLatency_->startTimer();
+    PinnableSlice value;
+    Status res = db_->Get(readOptions_, db_->DefaultColumnFamily(), Slice((const char*) key, sizeof(key)), &value);
+    indexLookupTimer.completed();
+
+    if (res.IsNotFound()) {
+        return nullptr;
+    } else if (!res.ok()) {
+        throw std::runtime_error("Failed to read index: " + res.ToString());
+    } else if (value.size() < 2 * sizeof(int64_t)) {
+        throw std::runtime_error("Invalid index entry size");
+    }
+
+    const int64_t* location = (const int64_t*) value.data();
+    return entryLogger_->readEntry(ledgerId, entryId,
+            EntryLocation { (uint32_t) Endian::big(location[0]), (uint64_t) Endian::big(location[1]) });
+}
+
+bool Storage::getRange(int64_t ledgerId, int64_t firstEntryId, int maxCount, size_t maxBytes,
+        std::vector<IOBufPtr>& entries) {
+    int64_t nextEntryId = firstEntryId;
+    size_t bytes = 0;
+    bool firstEntryTooLarge = false;
+
+    auto addEntry = [&](IOBufPtr data) {
+        size_t length = data->computeChainDataLength();
+        if (bytes + length > maxBytes) {
+            firstEntryTooLarge = entries.empty();
+            return false;
+        }
+
+        bytes += length;
+        entries.push_back(std::move(data));
+        ++nextEntryId;
+        return (int) entries.size() < maxCount;
+    };
+
+    int64_t key[2] = { Endian::big(ledgerId), Endian::big(firstEntryId) };
+
+    ReadOptions readOptions;
+    readOptions.prefix_same_as_start = true;
+    std::unique_ptr<Iterator> it(db_->NewIterator(readOptions));
+
+    bool hasMore = maxCount > 0;
+    for (it->Seek(Slice((const char*) key, sizeof(key))); hasMore && it->Valid(); it->Next()) {
+        const int64_t* entryKey = (const int64_t*) it->key().data();
+        const int64_t* location = (const int64_t*) it->value().data();
+        if (Endian::big(entryKey[0]) != ledgerId || Endian::big(entryKey[1]) != nextEntryId) {
+            break;
+        }
+
+        hasMore = addEntry(entryLogger_->readEntry(ledgerId, nextEntryId,
+                EntryLocation { (uint32_t) Endian::big(location[0]), (uint64_t) Endian::big(location[1]) }));
+    }
+
+    if (!it->status().ok()) {
+        throw std::runtime_error("Failed to read index: " + it->status().ToString());
+    }
+
+    // The most recent entries might not be in the index yet
+    while (hasMore && writeCache_) {
+        IOBufPtr data = writeCache_->get(ledgerId, nextEntryId);
+        if (!data) {
+            break;
+        }
+
+        hasMore = addEntry(std::move(data));
+    }
+
+    return !firstEntryTooLarge;
+}
+
+bool Storage::getLedgerInfo(int64_t ledgerId, LedgerInfo& info) {
+    return ledgerDirectory_.get(ledgerId, info);
+}
+
+Future<bool> Storage::waitForEntry(int64_t ledgerId, int64_t previousEntryId, steady_clock::duration timeout) {
+    return ledgerDirectory_.waitForEntry(ledgerId, previousEntryId, timeout);
+}
+
+void Storage::entriesPersisted(const std::vector<LogEntry>& entries) {
+    ledgerDirectory_.addEntries(entries);
+    releasePendingAdds(entries);
+}
+
+void Storage::entriesFailed(const std::vector<LogEntry>& entries) {
+    releasePendingAdds(entries);
+
+    if (!writeCache_) {
+        return;
+    }
+
+    // The entries won't make it to the ledger storage, they would otherwise never be evicted
+    for (const LogEntry& entry : entries) {
+        writeCache_->remove(entry.ledgerId, entry.entryId);
+    }
+}
+
+void Storage::releasePendingAdds(const std::vector<LogEntry>& entries) {
+    size_t bytes = 0;
+    for (const LogEntry& entry : entries) {
+        bytes += entry.data->computeChainDataLength();
+    }
+
+    pendingAddEntries_ -= entries.size();
+    pendingAddBytes_ -= bytes;
+    memoryAccountant_.release(MemoryAccountant::Consumer::PendingAdds, bytes);
+}
+
+LedgerInfo Storage::loadLedgerInfo(int64_t ledgerId) {
+    // Only look at the entries stored before startup, the later ones are tracked by the ledger directory
+    return storedLedgerInfo(ledgerId, startupSnapshot_);
+}
+
+LedgerInfo Storage::storedLedgerInfo(int64_t ledgerId, const rocksdb::Snapshot* snapshot) {
+    int64_t key = Endian::big(ledgerId);
+
+    ReadOptions readOptions;
+    readOptions.snapshot = snapshot;
+    PinnableSlice value;
+    Status res = db_->Get(readOptions, ledgersColumnFamily_, Slice((const char*) &key, sizeof(key)), &value);
+
+    if (res.IsNotFound()) {
+        return ledgersMetadataComplete_ ? LedgerInfo { BookieConstant::InvalidEntryId, 0, 0 }
+                : scanLedgerInfo(ledgerId, snapshot);
+    } else if (!res.ok()) {
+        throw std::runtime_error("Failed to read ledger metadata: " + res.ToString());
+    } else if (value.size() < 3 * sizeof(int64_t)) {
+        throw std::runtime_error("Invalid ledger metadata size");
+    }
+
+    const int64_t* info = (const int64_t*) value.data();
+    return LedgerInfo { Endian::big(info[0]), Endian::big(info[1]), Endian::big(info[2]) };
+}
+
+LedgerInfo Storage::scanLedgerInfo(int64_t ledgerId, const rocksdb::Snapshot* snapshot) {
+    int64_t key[2] = { Endian::big(ledgerId), Endian::big(std::numeric_limits<int64_t>::max()) };
+    LedgerInfo info { BookieConstant::InvalidEntryId, 0, 0 };
+
+    ReadOptions readOptions;
+    readOptions.snapshot = snapshot;
+    readOptions.prefix_same_as_start = true;
+    std::unique_ptr<Iterator> it(db_->NewIterator(readOptions));
+
+    for (it->SeekForPrev(Slice((const char*) key, sizeof(key))); it->Valid(); it->Prev()) {
+        const int64_t* entryKey = (const int64_t*) it->key().data();
+        if (it->key().size() != sizeof(key) || Endian::big(entryKey[0]) != ledgerId) {
+            break;
         }
 
-        if (entriesToSync.empty()) {
-            continue;
+        if (info.entryCount == 0) {
+            info.lastEntryId = Endian::big(entryKey[1]);
         }
 
-        Timer syncLatencyTimer = journalSyncLatency->startTimer();
-        db_->Write(syncOptions, &writeBatch);
-        syncLatencyTimer.completed();
+        info.entryCount += 1;
+        if (it->value().size() >= 3 * sizeof(int64_t)) {
+            info.size += Endian::big(((const int64_t*) it->value().data())[2]);
+        }
+    }
+
+    if (!it->status().ok()) {
+        throw std::runtime_error("Failed to read index: " + it->status().ToString());
+    }
 
-        for (auto& pr : entriesToSync) {
-            pr->setValue(unit);
+    return info;
+}
+
+Journal& Storage::journalForLedger(int64_t ledgerId) {
+    return *journals_[journalIndex(ledgerId)];
+}
+
+size_t Storage::journalIndex(int64_t ledgerId) const {
+    return hash::twang_mix64(ledgerId) % journals_.size();
+}
+
+void Storage::runCheckpoint() {
+    setThreadName("bookie-ckpt");
+
+    std::unique_lock<std::mutex> lock(checkpointMutex_);
+    while (!checkpointCondition_.wait_for(lock, checkpointInterval_, [this] {return stopping_;})) {
+        lock.unlock();
+
+        try {
+            checkpoint();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to checkpoint: " << e.what());
         }
 
-        entriesToSync.clear();
-        writeBatch.Clear();
+        lock.lock();
     }
 }
+
+void Storage::checkpoint() {
+    Timer checkpointTimer = checkpointLatency_->startTimer();
+
+    // Everything before these marks is already in the entry logs and in the index
+    std::vector<JournalMark> marks;
+    for (auto& journal : journals_) {
+        marks.push_back(journal->lastMark());
+    }
+
+    entryLogger_->flush();
+
+    Status res = db_->FlushWAL(true);
+    if (!res.ok()) {
+        throw std::runtime_error("Failed to sync index: " + res.ToString());
+    }
+
+    for (size_t i = 0; i < journals_.size(); i++) {
+        journals_[i]->checkpointCompleted(marks[i]);
+    }
+
+    checkpointTimer.completed();
+}
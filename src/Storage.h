@@ -23,48 +23,192 @@
 #include <rocksdb/db.h>
 #include <folly/futures/Future.h>
 #include <folly/io/IOBuf.h>
-#include <folly/MPMCQueue.h>
+#include <wangle/concurrent/CPUThreadPoolExecutor.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include "BookieConfig.h"
+#include "EntryLogger.h"
+#include "Journal.h"
+#include "LedgerDirectory.h"
+#include "LogRecord.h"
+#include "MemoryAccountant.h"
 #include "Metrics.h"
+#include "ReadAheadCache.h"
+#include "WriteCache.h"
 
 using namespace folly;
 using rocksdb::Slice;
 typedef std::unique_ptr<IOBuf> IOBufPtr;
 
+/**
+ * Entries are made durable in the journal, while the payloads are stored in the entry logs and RocksDB only
+ * keeps the index of (ledgerId, entryId) -> (logId, offset). The last entry id, the number of entries and the size
+ * of each ledger are kept in a separate column family, updated in the same write as the index.
+ *
+ * The entry logs and the index are synced by a periodic checkpoint, after which the journal files are no longer
+ * needed.
+ *
+ * The recently added entries are also kept in a write cache, which serves the tailing reads, while the ledgers
+ * being read sequentially get their next entries prefetched into a read-ahead cache, by a background thread.
+ */
 class Storage {
 public:
-    Storage(const BookieConfig& conf, MetricsManager& metricsManager);
+    /**
+     * @param shardId in partitioned mode, the shard owning this storage, which gets its own directories and its share
+     * of the caches and queue limits. -1 for a storage owning all the ledgers.
+     * @param sharedMemoryAccountant the memory budget of all the shards, or null to have one for this storage
+     */
+    Storage(const BookieConfig& conf, MetricsManager& metricsManager, int shardId = -1,
+            MemoryAccountant* sharedMemoryAccountant = nullptr);
     ~Storage();
 
-    Future<Unit> put(int64_t ledgerId, int64_t entryId, IOBufPtr data);
+    /**
+     * Put an entry. The completion callback is invoked once the entry is durable in the journal.
+     *
+     * @return false if the journal queue is full, in which case the entry is dropped and the callback not invoked
+     */
+    bool put(int64_t ledgerId, int64_t entryId, IOBufPtr data, AddCompletion completion);
+
+    /**
+     * @return whether the entries being added are over the configured count or size limits
+     */
+    bool isOverloaded() const;
+
+    /**
+     * @return whether enough of the entries being added have completed, after having been overloaded
+     */
+    bool canResumeAdds() const;
+
+    /**
+     * Put multiple entries, with a single journal enqueue for all the entries that go to the same journal
+     *
+     * @return a future with the outcome of each entry, in the same order as the entries
+     */
+    Future<std::vector<AddStatus>> putEntries(std::vector<LogEntry> entries);
+
+    /**
+     * Add entries to the entry log and to the index. Called by the journals, once the entries are synced.
+     */
+    void addEntries(const std::vector<LogEntry>& entries);
+
+    /**
+     * Read an entry. The returned buffer points directly into the entry log, without copying the payload.
+     *
+     * @return nullptr if the entry doesn't exist
+     */
+    IOBufPtr get(int64_t ledgerId, int64_t entryId);
+
+    /**
+     * Read consecutive entries starting at firstEntryId, with a single scan of the index. Stops at the first
+     * missing entry.
+     *
+     * @param maxBytes max total size of the entries
+     * @return false if the first entry alone is larger than maxBytes, in which case no entries are returned
+     */
+    bool getRange(int64_t ledgerId, int64_t firstEntryId, int maxCount, size_t maxBytes,
+            std::vector<IOBufPtr>& entries);
+
+    /**
+     * Get the last entry id, the number of entries and the size of a ledger, counting only the durable entries
+     *
+     * @return false if the ledger has no entries
+     */
+    bool getLedgerInfo(int64_t ledgerId, LedgerInfo& info);
+
+    /**
+     * Wait until the ledger has a durable entry after previousEntryId
+     *
+     * @return a future set to true once there is a new entry, or to false if the timeout expires first
+     */
+    Future<bool> waitForEntry(int64_t ledgerId, int64_t previousEntryId, steady_clock::duration timeout);
+
+    /**
+     * Called by the journals once the entries are durable
+     */
+    void entriesPersisted(const std::vector<LogEntry>& entries);
+
+    /**
+     * Called by the journals when the entries could not be written
+     */
+    void entriesFailed(const std::vector<LogEntry>& entries);
 
 private:
-    void runJournal();
+    void openDatabase(const std::string& indexDirectory, const std::vector<int>& cpus, int numShards);
+
+    Journal& journalForLedger(int64_t ledgerId);
+    size_t journalIndex(int64_t ledgerId) const;
+
+    IOBufPtr readEntry(int64_t ledgerId, int64_t entryId);
+    LedgerInfo loadLedgerInfo(int64_t ledgerId);
+
+    /**
+     * Read the stored metadata of a ledger, or compute it from the index for the ledgers written before the metadata
+     * was stored
+     */
+    LedgerInfo storedLedgerInfo(int64_t ledgerId, const rocksdb::Snapshot* snapshot);
+    LedgerInfo scanLedgerInfo(int64_t ledgerId, const rocksdb::Snapshot* snapshot);
+    void prefetchEntries(int64_t ledgerId, ReadAheadCache::Prefetch prefetch);
+    void releasePendingAdds(const std::vector<LogEntry>& entries);
+
+    void runCheckpoint();
+    void checkpoint();
+
+    // Distinguishes the gauges of the storage shards
+    const std::string gaugeSuffix_;
 
     rocksdb::DB* db_;
+    rocksdb::ColumnFamilyHandle* ledgersColumnFamily_;
+
+    // False if the index was created before the ledgers metadata was stored, the ledgers without metadata are then
+    // looked up in the index
+    bool ledgersMetadataComplete_;
     const rocksdb::WriteOptions writeOptions_;
+    const rocksdb::ReadOptions readOptions_;
+
+    std::unique_ptr<EntryLogger> entryLogger_;
+
+    // Declared before the caches, which release their memory when destroyed. Null for the storage shards, which
+    // share the budget of the bookie.
+    std::unique_ptr<MemoryAccountant> ownMemoryAccountant_;
+    MemoryAccountant& memoryAccountant_;
+
+    // Null if the caches are disabled
+    std::unique_ptr<WriteCache> writeCache_;
+    std::unique_ptr<ReadAheadCache> readAheadCache_;
+
+    // Reads the prefetched entries in the background, so that the reads don't wait for them
+    std::unique_ptr<wangle::CPUThreadPoolExecutor> prefetchExecutor_;
+
+    // Entries are routed to a journal by ledgerId, to preserve the ordering within each ledger
+    std::vector<std::unique_ptr<Journal>> journals_;
+
+    const seconds checkpointInterval_;
+    std::mutex checkpointMutex_;
+    std::condition_variable checkpointCondition_;
+    bool stopping_;
+    std::thread checkpointThread_;
 
-    typedef std::unique_ptr<Promise<Unit>> PromisePtr;
+    LedgerDirectory ledgerDirectory_;
+    const rocksdb::Snapshot* startupSnapshot_;
 
-    struct JournalEntry {
-        Slice key;
-        IOBufPtr data;
-        PromisePtr promise;
-        Timer walTimeSpentInQueue;
-    };
+    MetricsManager& metricsManager_;
 
-    MPMCQueue<JournalEntry> journalQueue_;
+    // Entries added and not yet completed by the journals
+    const size_t maxPendingAddEntries_;
+    const size_t maxPendingAddBytes_;
+    std::atomic<size_t> pendingAddEntries_;
 
-    const bool fsyncWal_;
-    std::thread journalThread_;
+    // Tracked here as well, since the storage shards share the memory accountant
+    std::atomic<size_t> pendingAddBytes_;
 
     MetricPtr rocksDbPutLatency_;
-    MetricPtr addEntryEnqueueLatency_;
-    MetricPtr walSyncLatency_;
-    MetricPtr walQueueLatency_;
+    MetricPtr checkpointLatency_;
+    MetricPtr indexLookupLatency_;
 };
 
@@ -0,0 +1,118 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "CpuAffinity.h"
+#include "Logging.h"
+#include "StorageShard.h"
+
+#include <folly/Conv.h>
+#include <folly/ThreadName.h>
+
+DECLARE_LOG_OBJECT();
+
+// Tasks queued by a single producer before the shard gets to them
+static const uint32_t RingSize = 1024;
+
+// Ring of the calling thread in each shard, assigned on the first submit
+static std::atomic<size_t> nextProducerId(0);
+
+static size_t producerId() {
+    static thread_local size_t id = nextProducerId++;
+    return id;
+}
+
+StorageShard::StorageShard(int shardId, size_t numProducers, int cpu, const BookieConfig& conf,
+        MetricsManager& metricsManager, MemoryAccountant& memoryAccountant) :
+        shardId_(shardId),
+        storage_(conf, metricsManager, shardId, &memoryAccountant),
+        numProducers_(numProducers),
+        rings_(new std::atomic<Ring*>[numProducers]),
+        drainScheduled_(false),
+        eventBase_(),
+        thread_() {
+    for (size_t i = 0; i < numProducers_; i++) {
+        rings_[i] = nullptr;
+    }
+
+    thread_ = std::thread(std::bind(&StorageShard::run, this, cpu));
+}
+
+StorageShard::~StorageShard() {
+    eventBase_.terminateLoopSoon();
+    thread_.join();
+
+    for (size_t i = 0; i < numProducers_; i++) {
+        delete rings_[i].load();
+    }
+}
+
+bool StorageShard::submit(Task task) {
+    size_t producer = producerId();
+    if (producer >= numProducers_) {
+        // Threads other than the IO ones go through the event base queue
+        eventBase_.runInEventBaseThread(std::move(task));
+        return true;
+    }
+
+    Ring* ring = rings_[producer].load(std::memory_order_acquire);
+    if (!ring) {
+        ring = new Ring(RingSize);
+        rings_[producer].store(ring, std::memory_order_release);
+    }
+
+    if (!ring->write(std::move(task))) {
+        return false;
+    }
+
+    // A single wake-up is pending at any time, the shard thread drains all the rings when it runs
+    if (!drainScheduled_.exchange(true)) {
+        eventBase_.runInEventBaseThread([this] {
+            drainScheduled_ = false;
+            drain();
+        });
+    }
+
+    return true;
+}
+
+void StorageShard::run(int cpu) {
+    setThreadName(to<std::string>("bookie-shard-", shardId_));
+    if (cpu >= 0) {
+        CpuAffinity::pinCurrentThread( { cpu });
+    }
+
+    eventBase_.loopForever();
+}
+
+void StorageShard::drain() {
+    Task task;
+
+    for (size_t i = 0; i < numProducers_; i++) {
+        Ring* ring = rings_[i].load(std::memory_order_acquire);
+        if (!ring) {
+            continue;
+        }
+
+        while (ring->read(task)) {
+            task();
+            task = nullptr;
+        }
+    }
+}
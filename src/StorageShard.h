@@ -0,0 +1,93 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/ProducerConsumerQueue.h>
+#include <folly/io/async/EventBase.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BookieConfig.h"
+#include "Metrics.h"
+#include "Storage.h"
+
+using namespace folly;
+
+/**
+ * A partition of the ledgers, in partitioned mode. Each shard has its own storage, with its own journals, entry logs
+ * and index, and its own thread running an event base, on which all the operations of the shard are executed.
+ *
+ * This is not a thread-per-core design: the shard thread hands the adds to the journals of its storage, which have
+ * their own journal and sync threads, as well as the checkpoint and prefetch threads. Each shard runs its own set of
+ * these threads. The shards only share the memory budget of the bookie.
+ *
+ * The IO threads hand the operations to the shard through single-producer single-consumer rings, one for each IO
+ * thread, so that the IO threads never contend with each other on a shared queue. The shard thread is woken up once
+ * per batch of operations, not for each of them.
+ */
+class StorageShard {
+public:
+    typedef Function<void()> Task;
+
+    /**
+     * @param numProducers number of threads submitting tasks, each having its own ring
+     * @param memoryAccountant the memory budget shared by all the shards
+     */
+    StorageShard(int shardId, size_t numProducers, int cpu, const BookieConfig& conf,
+            MetricsManager& metricsManager, MemoryAccountant& memoryAccountant);
+    ~StorageShard();
+
+    /**
+     * Run a task on the shard thread
+     *
+     * @return false if the ring of the calling thread is full, in which case the task is dropped
+     */
+    bool submit(Task task);
+
+    /**
+     * The storage is thread-safe, the operations that don't need to be serialized with the others can access it
+     * directly
+     */
+    Storage& storage() {
+        return storage_;
+    }
+
+private:
+    typedef ProducerConsumerQueue<Task> Ring;
+
+    void run(int cpu);
+    void drain();
+
+    const int shardId_;
+    Storage storage_;
+
+    // Allocated by each producer on its first submit
+    const size_t numProducers_;
+    std::unique_ptr<std::atomic<Ring*>[]> rings_;
+    std::atomic<bool> drainScheduled_;
+
+    EventBase eventBase_;
+    std::thread thread_;
+};
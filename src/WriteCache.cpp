@@ -0,0 +1,174 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "WriteCache.h"
+
+#include <folly/Hash.h>
+
+WriteCache::WriteCache(size_t maxSize, MemoryAccountant& memoryAccountant, MetricsManager& metricsManager,
+        const std::string& gaugeSuffix) :
+        maxSegmentSize_(maxSize / NumSegments),
+        size_(0),
+        hits_(0),
+        misses_(0),
+        memoryAccountant_(memoryAccountant),
+        metricsManager_(metricsManager),
+        gaugeSuffix_(gaugeSuffix) {
+    metricsManager_.registerGauge("writeCacheSize" + gaugeSuffix_, [this] {
+        return (double) size_;
+    });
+
+    metricsManager_.registerGauge("writeCacheHitRatio" + gaugeSuffix_, [this] {
+        // Ratio over the last stats period
+        uint64_t hits = hits_.exchange(0);
+        uint64_t misses = misses_.exchange(0);
+        return hits + misses == 0 ? 0.0 : (double) hits / (hits + misses);
+    });
+}
+
+WriteCache::~WriteCache() {
+    metricsManager_.removeGauge("writeCacheSize" + gaugeSuffix_);
+    metricsManager_.removeGauge("writeCacheHitRatio" + gaugeSuffix_);
+
+    size_t flushedSize = 0;
+    for (Segment& segment : segments_) {
+        for (auto& entry : segment.entries) {
+            flushedSize += entry.second.flushed ? entry.second.size : 0;
+        }
+    }
+    memoryAccountant_.release(MemoryAccountant::Consumer::WriteCache, flushedSize);
+}
+
+void WriteCache::put(int64_t ledgerId, int64_t entryId, const IOBuf& data) {
+    Key key { ledgerId, entryId };
+    size_t entrySize = data.computeChainDataLength();
+
+    Segment& segment = segmentFor(key);
+    std::lock_guard<std::mutex> lock(segment.mutex);
+
+    // A retried add replaces the previous copy of the entry
+    removeEntry(segment, key);
+
+    evict(segment, entrySize, maxSegmentSize_);
+    if (segment.size + entrySize > maxSegmentSize_) {
+        // Full of entries that are not yet in the ledger storage
+        return;
+    }
+
+    uint64_t sequence = segment.nextSequence++;
+    segment.entries.emplace(key, CachedEntry { data.clone(), entrySize, sequence, false });
+    segment.insertionOrder.emplace_back(key, sequence);
+    segment.size += entrySize;
+    size_ += entrySize;
+}
+
+IOBufPtr WriteCache::get(int64_t ledgerId, int64_t entryId) {
+    Key key { ledgerId, entryId };
+    Segment& segment = segmentFor(key);
+
+    {
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        auto it = segment.entries.find(key);
+        if (it != segment.entries.end()) {
+            ++hits_;
+            return it->second.data->clone();
+        }
+    }
+
+    ++misses_;
+    return nullptr;
+}
+
+void WriteCache::markFlushed(const std::vector<LogEntry>& entries) {
+    for (const LogEntry& entry : entries) {
+        Key key { entry.ledgerId, entry.entryId };
+        Segment& segment = segmentFor(key);
+
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        auto it = segment.entries.find(key);
+        if (it != segment.entries.end() && !it->second.flushed) {
+            it->second.flushed = true;
+            memoryAccountant_.charge(MemoryAccountant::Consumer::WriteCache, it->second.size);
+        }
+    }
+}
+
+void WriteCache::remove(int64_t ledgerId, int64_t entryId) {
+    Key key { ledgerId, entryId };
+    Segment& segment = segmentFor(key);
+
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    removeEntry(segment, key);
+}
+
+size_t WriteCache::shrink(size_t bytes) {
+    size_t share = bytes / NumSegments + 1;
+    size_t freed = 0;
+
+    for (Segment& segment : segments_) {
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        size_t sizeBefore = segment.size;
+        evict(segment, 0, sizeBefore > share ? sizeBefore - share : 0);
+        freed += sizeBefore - segment.size;
+    }
+
+    return freed;
+}
+
+void WriteCache::evict(Segment& segment, size_t requiredSize, size_t maxSize) {
+    while (segment.size + requiredSize > maxSize && !segment.insertionOrder.empty()) {
+        const std::pair<Key, uint64_t>& oldest = segment.insertionOrder.front();
+        auto it = segment.entries.find(oldest.first);
+
+        if (it != segment.entries.end() && it->second.sequence == oldest.second) {
+            if (!it->second.flushed) {
+                // The entries after this one were added later, they are not likely to be flushed either
+                return;
+            }
+
+            segment.size -= it->second.size;
+            size_ -= it->second.size;
+            memoryAccountant_.release(MemoryAccountant::Consumer::WriteCache, it->second.size);
+            segment.entries.erase(it);
+        }
+
+        segment.insertionOrder.pop_front();
+    }
+}
+
+void WriteCache::removeEntry(Segment& segment, const Key& key) {
+    auto it = segment.entries.find(key);
+    if (it != segment.entries.end()) {
+        segment.size -= it->second.size;
+        size_ -= it->second.size;
+        if (it->second.flushed) {
+            memoryAccountant_.release(MemoryAccountant::Consumer::WriteCache, it->second.size);
+        }
+        segment.entries.erase(it);
+    }
+}
+
+WriteCache::Segment& WriteCache::segmentFor(const Key& key) {
+    return segments_[KeyHash()(key) % NumSegments];
+}
+
+size_t WriteCache::KeyHash::operator()(const Key& key) const {
+    return hash::hash_128_to_64(hash::twang_mix64(key.ledgerId), hash::twang_mix64(key.entryId));
+}
@@ -0,0 +1,134 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LogRecord.h"
+#include "MemoryAccountant.h"
+#include "Metrics.h"
+
+using folly::IOBuf;
+typedef std::unique_ptr<IOBuf> IOBufPtr;
+
+/**
+ * Keeps the recently added entries in memory, to serve the tailing reads without going to the entry logs.
+ *
+ * The cache holds clones of the entries buffers, sharing the memory received from the network. Entries are
+ * evicted in insertion order, once they have been added to the entry logs and the index. Until then, they can only
+ * be read from the cache, so they are never evicted and new entries are not cached when the cache is full of them.
+ *
+ * The entries are only charged to the memory budget once flushed. Before that, their buffers are already counted by
+ * the pending adds.
+ */
+class WriteCache {
+public:
+    /**
+     * @param gaugeSuffix appended to the names of the gauges, to tell apart the caches of the storage shards
+     */
+    WriteCache(size_t maxSize, MemoryAccountant& memoryAccountant, MetricsManager& metricsManager,
+            const std::string& gaugeSuffix = "");
+    ~WriteCache();
+
+    void put(int64_t ledgerId, int64_t entryId, const IOBuf& data);
+
+    /**
+     * @return a clone of the cached entry, or nullptr if the entry is not in the cache
+     */
+    IOBufPtr get(int64_t ledgerId, int64_t entryId);
+
+    /**
+     * Mark the entries as readable from the ledger storage, which makes them available for eviction
+     */
+    void markFlushed(const std::vector<LogEntry>& entries);
+
+    void remove(int64_t ledgerId, int64_t entryId);
+
+    /**
+     * Evict flushed entries to free up memory, taking the same share from each segment
+     *
+     * @return the number of bytes freed
+     */
+    size_t shrink(size_t bytes);
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    struct Key {
+        int64_t ledgerId;
+        int64_t entryId;
+
+        bool operator==(const Key& other) const {
+            return ledgerId == other.ledgerId && entryId == other.entryId;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct CachedEntry {
+        IOBufPtr data;
+        size_t size;
+        uint64_t sequence;
+        bool flushed;
+    };
+
+    // The cache is split in segments, each with its own lock and its own share of the max size
+    struct Segment {
+        std::mutex mutex;
+        std::unordered_map<Key, CachedEntry, KeyHash> entries;
+
+        // Insertion order. Keys that were removed or replaced in the meantime are skipped when evicting.
+        std::deque<std::pair<Key, uint64_t>> insertionOrder;
+        size_t size = 0;
+        uint64_t nextSequence = 0;
+    };
+
+    Segment& segmentFor(const Key& key);
+
+    void evict(Segment& segment, size_t requiredSize, size_t maxSize);
+    void removeEntry(Segment& segment, const Key& key);
+
+    static const int NumSegments = 16;
+
+    const size_t maxSegmentSize_;
+    Segment segments_[NumSegments];
+
+    std::atomic<size_t> size_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    MemoryAccountant& memoryAccountant_;
+    MetricsManager& metricsManager_;
+    const std::string gaugeSuffix_;
+};
@@ -0,0 +1,72 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "WriteCoalescingHandler.h"
+#include "Logging.h"
+
+DECLARE_LOG_OBJECT();
+
+static const int MaxResponsesPerWrite = 10000;
+
+WriteCoalescingHandler::WriteCoalescingHandler(MetricsManager& metricsManager) :
+        ctx_(nullptr),
+        pending_(IOBufQueue::cacheChainLength()),
+        pendingWrites_(0),
+        responsesPerWrite_(metricsManager.createValueMetric("responsesPerWrite", MaxResponsesPerWrite)) {
+}
+
+Future<Unit> WriteCoalescingHandler::write(Context* ctx, std::unique_ptr<IOBuf> buf) {
+    pending_.append(std::move(buf));
+    frameQueued(ctx);
+    return makeFuture();
+}
+
+void WriteCoalescingHandler::frameQueued(Context* ctx) {
+    ctx_ = ctx;
+    ++pendingWrites_;
+
+    if (!isLoopCallbackScheduled()) {
+        ctx->getTransport()->getEventBase()->runInLoop(this);
+    }
+}
+
+Future<Unit> WriteCoalescingHandler::close(Context* ctx) {
+    // Don't drop the responses that are already serialized
+    cancelLoopCallback();
+    flush();
+    return ctx->fireClose();
+}
+
+void WriteCoalescingHandler::runLoopCallback() noexcept {
+    flush();
+}
+
+void WriteCoalescingHandler::flush() {
+    if (pending_.empty()) {
+        return;
+    }
+
+    responsesPerWrite_->addValueSample(pendingWrites_);
+    pendingWrites_ = 0;
+
+    ctx_->fireWrite(pending_.move()).onError([](const std::exception& e) {
+        LOG_WARN("Failed to write responses: " << e.what());
+    });
+}
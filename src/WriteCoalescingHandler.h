@@ -0,0 +1,78 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#pragma once
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBase.h>
+#include <wangle/channel/Handler.h>
+
+#include "Metrics.h"
+
+using namespace wangle;
+using namespace folly;
+
+/**
+ * Outbound handler that gathers the frames written during one iteration of the connection event loop and flushes
+ * them to the socket as a single chained write, at the end of the iteration.
+ *
+ * The writes are always reported as successful, a failed flush is only logged. Only the pipeline event base thread
+ * can write through this handler.
+ */
+class WriteCoalescingHandler: public OutboundBytesToBytesHandler, private EventBase::LoopCallback {
+public:
+    explicit WriteCoalescingHandler(MetricsManager& metricsManager);
+
+    Future<Unit> write(Context* ctx, std::unique_ptr<IOBuf> buf) override;
+
+    Future<Unit> close(Context* ctx) override;
+
+    /**
+     * Queue a frame directly, without going through the pipeline. The header is serialized in the tailroom of the
+     * pending buffers, so it doesn't need a buffer of its own, and the payload is chained after it.
+     */
+    template<typename Serializer>
+    void writeFrame(Serializer&& serializeHeader, std::unique_ptr<IOBuf> payload) {
+        io::QueueAppender appender(&pending_, HeaderBufferSize);
+        serializeHeader(appender);
+
+        if (payload) {
+            pending_.append(std::move(payload));
+        }
+
+        frameQueued(getContext());
+    }
+
+private:
+    static const size_t HeaderBufferSize = 4096;
+
+    void frameQueued(Context* ctx);
+
+    void runLoopCallback() noexcept override;
+
+    void flush();
+
+    Context* ctx_;
+    IOBufQueue pending_;
+    int pendingWrites_;
+
+    MetricPtr responsesPerWrite_;
+};
@@ -0,0 +1,201 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "BookieConfig.h"
+#include "Logging.h"
+#include "Storage.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <folly/Format.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+DECLARE_LOG_OBJECT();
+
+/**
+ * Number of allocations done through operator new, on all the threads. Buffers allocated directly with malloc, like
+ * the IOBuf ones, are not counted.
+ */
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+struct Arguments {
+    std::string directory;
+    int msgSize;
+    int numEntries;
+    int warmupEntries;
+    int numJournals;
+    bool writeCache;
+    bool fsync;
+};
+
+/**
+ * Add the entries through the storage, as the bookie does for the add requests, and wait for all of them to be
+ * persisted
+ */
+static void addEntries(Storage& storage, std::vector<IOBufPtr>& payloads, int64_t firstEntryId) {
+    std::atomic<size_t> completed(0);
+    std::atomic<size_t> failed(0);
+
+    for (size_t i = 0; i < payloads.size(); i++) {
+        // Apply the same back-pressure as the bookie does on the connections
+        while (storage.isOverloaded()) {
+            std::this_thread::sleep_for(microseconds(100));
+        }
+
+        // Spread the entries over a few ledgers, to use all the journals
+        int64_t entryId = firstEntryId + i;
+        bool queued = storage.put(entryId % 16, entryId, std::move(payloads[i]), AddCompletion { nullptr,
+            [&](AddStatus status) {
+                if (status != AddStatus::Persisted) {
+                    ++failed;
+                }
+                ++completed;
+            } });
+
+        if (!queued) {
+            LOG_FATAL("Journal queue is full");
+            std::exit(-1);
+        }
+    }
+
+    while (completed < payloads.size()) {
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+
+    if (failed > 0) {
+        LOG_FATAL("Failed to persist " << failed << " entries");
+        std::exit(-1);
+    }
+}
+
+static std::vector<IOBufPtr> createPayloads(const std::string& payload, int count) {
+    std::vector<IOBufPtr> payloads;
+    payloads.reserve(count);
+    for (int i = 0; i < count; i++) {
+        payloads.push_back(IOBuf::wrapBuffer(payload.data(), payload.size()));
+    }
+
+    return payloads;
+}
+
+int main(int argc, char** argv) {
+    Logging::init();
+
+    Arguments args;
+
+    po::options_description options;
+    options.add_options() //
+    ("help,h", "This help message") //
+    ("directory,d", po::value<std::string>(&args.directory)->default_value("./perf-add-entry"),
+            "Directory where to write the journal, the entry logs and the index") //
+    ("msg-size,s", po::value<int>(&args.msgSize)->default_value(1024), "Message size") //
+    ("num-entries,n", po::value<int>(&args.numEntries)->default_value(100000), "Number of entries to measure") //
+    ("warmup-entries", po::value<int>(&args.warmupEntries)->default_value(100000),
+            "Number of entries added before measuring, to fill the pools and the caches") //
+    ("num-journals,j", po::value<int>(&args.numJournals)->default_value(1), "Number of journals") //
+    ("write-cache", po::value<bool>(&args.writeCache)->default_value(true),
+            "Keep the added entries in the write cache") //
+    ("fsync", po::value<bool>(&args.fsync)->default_value(true), "Sync the journal before acknowledging the entries") //
+            ;
+
+    po::variables_map map;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(options).run(), map);
+        po::notify(map);
+
+        if (map.count("help")) {
+            std::cerr << options << std::endl;
+            exit(1);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error parsing parameters -- " << e.what() << std::endl << std::endl;
+        std::cerr << options << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> confArgs = { "perfAddEntry", //
+            "--dataDir", args.directory + "/data", //
+            "--walDir", args.directory + "/wal", //
+            "--numJournals", std::to_string(args.numJournals), //
+            "--fsyncWal", std::to_string(args.fsync), //
+            "--writeCacheMaxSize", args.writeCache ? "1073741824" : "0", //
+            "--checkpointIntervalSeconds", "3600" };
+
+    std::vector<char*> confArgv;
+    for (std::string& arg : confArgs) {
+        confArgv.push_back(&arg[0]);
+    }
+
+    BookieConfig conf;
+    if (!conf.parse(confArgv.size(), confArgv.data())) {
+        return -1;
+    }
+
+    std::string payload(args.msgSize, 'X');
+
+    {
+        MetricsManager metricsManager(seconds(3600));
+        Storage storage(conf, metricsManager);
+
+        std::vector<IOBufPtr> payloads = createPayloads(payload, args.warmupEntries);
+        addEntries(storage, payloads, 0);
+
+        // Only the allocations done by the add path are counted, the payloads are created upfront
+        payloads = createPayloads(payload, args.numEntries);
+
+        uint64_t allocationsBefore = allocations;
+        steady_clock::time_point start = steady_clock::now();
+
+        addEntries(storage, payloads, args.warmupEntries);
+
+        double elapsedSeconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        uint64_t addAllocations = allocations - allocationsBefore;
+
+        LOG_INFO(sformat("{} entries -- {:.0f} entries/s -- {} allocations -- {:.3f} allocations per add",
+                args.numEntries, args.numEntries / elapsedSeconds, addAllocations,
+                (double) addAllocations / args.numEntries));
+    }
+
+    fs::remove_all(args.directory);
+    return 0;
+}
@@ -24,9 +24,20 @@
 #include "Metrics.h"
 #include "BookieCodecV2.h"
 #include "RateLimiter.h"
+#include "ShmRing.h"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
 
 #include <wangle/bootstrap/ClientBootstrap.h>
 #include <wangle/channel/AsyncSocketHandler.h>
@@ -43,9 +54,11 @@ struct Arguments {
     std::string bookieAddress;
     double rate;
     int msgSize;
+    int batchSize;
     int numberOfConnections;
     int statsReportingRateSeconds;
     bool formatStatsJson;
+    std::string localTransportPath;
 };
 
 typedef Pipeline<IOBufQueue&, Request> BookieClientPipeline;
@@ -53,10 +66,12 @@ typedef ClientBootstrap<BookieClientPipeline> Client;
 
 class AddEntryTask: public HandlerAdapter<Response, Request> {
 public:
-    AddEntryTask(BookieClientPipeline::Ptr pipeline, double rate, int msgSize, MetricPtr addEntryMetric) :
+    AddEntryTask(BookieClientPipeline::Ptr pipeline, double rate, int msgSize, int batchSize,
+            MetricPtr addEntryMetric) :
             pipeline_(pipeline),
             rateLimiter_(rate),
             msgSize_(msgSize),
+            batchSize_(batchSize),
             addEntryMetric_(addEntryMetric),
             thread_() {
     }
@@ -73,13 +88,20 @@ public:
         EventBase* eventBase = pipeline_->getTransport()->getEventBase();
 
         while (true) {
+            if (batchSize_ > 1) {
+                sendBatch(ledgerId, entryIdGenerator, payload);
+                entryIdGenerator += batchSize_;
+                continue;
+            }
+
             rateLimiter_.aquire();
 
             int64_t entryId = entryIdGenerator++;
 
             eventBase->runInEventBaseThread([entryId, &ledgerId, &payload, &pipeline, this]() {
-                Request request {2, BookieOperation::AddEntry, ledgerId, entryId, 0, IOBuf::wrapBuffer(payload.c_str(),
-                            payload.length())};
+                // Leave room for the codec to write the header in front of the payload
+                Request request {2, BookieOperation::AddEntry, ledgerId, entryId, 0, IOBuf::copyBuffer(payload.c_str(),
+                            payload.length(), BookieClientCodecV2::AddEntryHeaderSize)};
                 LOG_DEBUG("Sending request " << request);
                 pipeline->write(std::move(request));
 
@@ -88,6 +110,26 @@ public:
         }
     }
 
+    void sendBatch(int64_t ledgerId, int64_t firstEntryId, const std::string& payload) {
+        rateLimiter_.aquire(batchSize_);
+
+        auto pipeline = pipeline_.get();
+        pipeline_->getTransport()->getEventBase()->runInEventBaseThread(
+                [ledgerId, firstEntryId, &payload, pipeline, this]() {
+                    Request request {2, BookieOperation::MultiAddEntry, ledgerId, firstEntryId, 0};
+                    for (int i = 0; i < batchSize_; i++) {
+                        request.entries.push_back(EntryPayload { ledgerId, firstEntryId + i,
+                            IOBuf::wrapBuffer(payload.c_str(), payload.length()) });
+                    }
+
+                    LOG_DEBUG("Sending request " << request);
+                    pipeline->write(std::move(request));
+
+                    // The whole batch is acked with a single response, for the first entry
+                    pendingRequests_.insert( {firstEntryId, std::move(addEntryMetric_->startTimer())});
+                });
+    }
+
     virtual void transportActive(Context* ctx) override {
         ctx->fireTransportActive();
         ctx->getTransport()->getPeerAddress(&bookieAddress_);
@@ -116,6 +158,7 @@ private:
     SocketAddress bookieAddress_;
     RateLimiter rateLimiter_;
     int msgSize_;
+    int batchSize_;
     MetricPtr addEntryMetric_;
     std::unique_ptr<std::thread> thread_;
 
@@ -126,16 +169,209 @@ private:
 
 std::atomic<int64_t> AddEntryTask::ledgerIdGenerator_;
 
+/**
+ * Sends the entries through the shared memory rings of the bookie local transport, instead of a TCP connection. The
+ * latency is measured the same way, to compare both transports.
+ */
+class LocalAddEntryTask {
+public:
+    LocalAddEntryTask(double rate, int msgSize, int batchSize, MetricPtr addEntryMetric) :
+            socket_(-1),
+            channel_(),
+            rateLimiter_(rate),
+            msgSize_(msgSize),
+            batchSize_(batchSize),
+            addEntryMetric_(addEntryMetric),
+            sender_(),
+            receiver_() {
+    }
+
+    ~LocalAddEntryTask() {
+        if (socket_ >= 0) {
+            ::close(socket_);
+        }
+    }
+
+    void start(const std::string& path) {
+        connect(path);
+        LOG_INFO("Started local add entry task " << path << " -- " << channel_->name());
+
+        sender_ = std::make_unique<std::thread>(std::bind(&LocalAddEntryTask::sendEntries, this));
+        receiver_ = std::make_unique<std::thread>(std::bind(&LocalAddEntryTask::receiveResponses, this));
+    }
+
+private:
+    void connect(const std::string& path) {
+        socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_ < 0) {
+            throwSystemError("Failed to create socket");
+        }
+
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        if (::connect(socket_, (sockaddr*) &address, sizeof(address)) != 0) {
+            throwSystemError("Failed to connect to ", path);
+        }
+
+        // The bookie sends the length prefixed name of the shared memory segment
+        uint32_t length;
+        if (readFull(socket_, &length, sizeof(length)) != sizeof(length)) {
+            throw std::runtime_error("Failed to read the local transport handshake");
+        }
+
+        std::string name(Endian::big(length), '\0');
+        if (readFull(socket_, &name[0], name.size()) != (ssize_t) name.size()) {
+            throw std::runtime_error("Failed to read the local transport handshake");
+        }
+
+        channel_ = ShmChannel::open(name);
+
+        // Both sides have it mapped
+        channel_->unlink();
+    }
+
+    void sendEntries() {
+        int64_t ledgerId = ledgerIdGenerator_++;
+        int64_t entryId = 0;
+
+        std::string payload;
+        payload.resize(msgSize_, 'X');
+
+        ShmRing& requests = channel_->requests();
+        const size_t size = batchSize_ > 1 ?
+                3 * sizeof(int32_t) + batchSize_ * (2 * sizeof(int64_t) + sizeof(int32_t) + msgSize_) :
+                BookieClientCodecV2::AddEntryHeaderSize + msgSize_;
+
+        while (true) {
+            rateLimiter_.aquire(batchSize_);
+
+            uint8_t* frame;
+            while (!(frame = requests.reserve(size))) {
+                // The bookie is not keeping up
+                std::this_thread::yield();
+            }
+
+            writeRequest(frame, size, ledgerId, entryId, payload);
+
+            {
+                // A batch is acked with a single response, for the first entry
+                std::lock_guard<std::mutex> lock(mutex_);
+                pendingRequests_.insert( {entryId, std::move(addEntryMetric_->startTimer())});
+            }
+
+            if (requests.commit(size)) {
+                ringDoorbell();
+            }
+
+            entryId += batchSize_;
+        }
+    }
+
+    void writeRequest(uint8_t* frame, size_t size, int64_t ledgerId, int64_t entryId, const std::string& payload) {
+        IOBuf buffer(IOBuf::WRAP_BUFFER, frame, size);
+        io::RWPrivateCursor writer(&buffer);
+        writer.writeBE<int32_t>(size - sizeof(int32_t));
+
+        if (batchSize_ > 1) {
+            writer.writeBE<int32_t>(PacketHeader { 2, BookieOperation::MultiAddEntry, 0 }.toInt());
+            writer.writeBE<int32_t>(batchSize_);
+
+            for (int i = 0; i < batchSize_; i++) {
+                writer.writeBE<int64_t>(ledgerId);
+                writer.writeBE<int64_t>(entryId + i);
+                writer.writeBE<int32_t>(payload.size());
+                writer.push((const uint8_t*) payload.data(), payload.size());
+            }
+        } else {
+            writer.writeBE<int32_t>(PacketHeader { 2, BookieOperation::AddEntry, 0 }.toInt());
+            writer.skip(BookieConstant::MasterKeyLength);
+            writer.writeBE<int64_t>(ledgerId);
+            writer.writeBE<int64_t>(entryId);
+            writer.push((const uint8_t*) payload.data(), payload.size());
+        }
+    }
+
+    void receiveResponses() {
+        ShmRing& responses = channel_->responses();
+
+        while (true) {
+            size_t size;
+            const uint8_t* frame = responses.peek(size);
+            if (!frame) {
+                if (responses.prepareToWait()) {
+                    waitForDoorbell();
+                }
+                continue;
+            }
+
+            // The add responses start with the error code, the ledger id and the entry id
+            IOBuf buffer(IOBuf::WRAP_BUFFER, frame + sizeof(int32_t), size - sizeof(int32_t));
+            io::Cursor reader(&buffer);
+            reader.skip(sizeof(int32_t));
+            BookieError errorCode = (BookieError) reader.readBE<int32_t>();
+            reader.skip(sizeof(int64_t));
+            int64_t entryId = reader.readBE<int64_t>();
+            responses.consume(size);
+
+            if (UNLIKELY(errorCode != BookieError::OK)) {
+                LOG_ERROR("Received error response: " << errorCode);
+                std::exit(-1);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = pendingRequests_.find(entryId);
+            it->second.completed();
+            pendingRequests_.erase(it);
+        }
+    }
+
+    void ringDoorbell() {
+        uint8_t doorbell = 1;
+        if (writeFull(socket_, &doorbell, sizeof(doorbell)) != sizeof(doorbell)) {
+            LOG_ERROR("Failed to wake up the bookie: " << errnoStr(errno));
+            std::exit(-1);
+        }
+    }
+
+    void waitForDoorbell() {
+        // Several doorbells can be read at once, a single one is enough to drain the ring
+        uint8_t doorbells[64];
+        if (readNoInt(socket_, doorbells, sizeof(doorbells)) <= 0) {
+            std::cout << "EOF received" << std::endl;
+            std::exit(-1);
+        }
+    }
+
+    int socket_;
+    std::unique_ptr<ShmChannel> channel_;
+    RateLimiter rateLimiter_;
+    int msgSize_;
+    int batchSize_;
+    MetricPtr addEntryMetric_;
+    std::unique_ptr<std::thread> sender_;
+    std::unique_ptr<std::thread> receiver_;
+
+    std::mutex mutex_;
+    std::unordered_map<int64_t, Timer> pendingRequests_;
+
+    static std::atomic<int64_t> ledgerIdGenerator_;
+};
+
+std::atomic<int64_t> LocalAddEntryTask::ledgerIdGenerator_;
+
 class BookieClientPipelineFactory: public PipelineFactory<BookieClientPipeline> {
     double perConnectionRate_;
     int msgSize_;
+    int batchSize_;
     MetricPtr addEntryMetric_;
 
 public:
 
-    BookieClientPipelineFactory(double rate, int msgSize, MetricPtr addEntryMetric) :
+    BookieClientPipelineFactory(double rate, int msgSize, int batchSize, MetricPtr addEntryMetric) :
             perConnectionRate_(rate),
             msgSize_(msgSize),
+            batchSize_(batchSize),
             addEntryMetric_(addEntryMetric) {
     }
 
@@ -144,7 +380,8 @@ public:
         pipeline->addBack(AsyncSocketHandler(sock));
         pipeline->addBack(LengthFieldBasedFrameDecoder(4, BookieConstant::MaxFrameSize));
         pipeline->addBack(BookieClientCodecV2());
-        pipeline->addBack(std::make_shared<AddEntryTask>(pipeline, perConnectionRate_, msgSize_, addEntryMetric_));
+        pipeline->addBack(std::make_shared<AddEntryTask>(pipeline, perConnectionRate_, msgSize_, batchSize_,
+                addEntryMetric_));
         pipeline->finalize();
         return pipeline;
     }
@@ -162,10 +399,15 @@ int main(int argc, char** argv) {
             "Boookie hostname and port") //
     ("rate,r", po::value<double>(&args.rate)->default_value(100), "Add entry rate") //
     ("msg-size,s", po::value<int>(&args.msgSize)->default_value(1024), "Message size") //
+    ("batch-size,b", po::value<int>(&args.batchSize)->default_value(1),
+            "Number of entries sent with each multi-add request, 1 to send single add requests") //
     ("num-connections,c", po::value<int>(&args.numberOfConnections)->default_value(16), "Number of connections") //
     ("format-stats", po::value<bool>(&args.formatStatsJson)->default_value(true), "Format stats JSON output") //
     ("stats-reporting", po::value<int>(&args.statsReportingRateSeconds)->default_value(10),
             "Interval to report latency stats in seconds") //
+    ("local-transport,l", po::value<std::string>(&args.localTransportPath)->default_value(""),
+            "Unix socket path of the bookie local transport, to send the entries through shared memory instead "
+                    "of TCP") //
             ;
 
     po::variables_map map;
@@ -189,25 +431,43 @@ int main(int argc, char** argv) {
     MetricsManager metricsManager(statsReportingPeriod);
     MetricPtr addEntryMetric = metricsManager.createMetric("add-entry-metric");
 
-    SocketAddress bookieAddress;
-    bookieAddress.setFromHostPort(args.bookieAddress);
-    LOG_INFO("Bookie address: " << bookieAddress);
-
     double perConnectionRate = args.rate / args.numberOfConnections;
 
     ClientBootstrap<BookieClientPipeline> client;
-    client.group(std::make_shared<wangle::IOThreadPoolExecutor>(std::thread::hardware_concurrency()));
-    client.pipelineFactory(
-            std::make_shared<BookieClientPipelineFactory>(perConnectionRate, args.msgSize, addEntryMetric));
-
-    std::vector<Future<BookieClientPipeline*>> connectFutures;
-    for (int i = 0; i < args.numberOfConnections; i++) {
-        auto future = client.connect(bookieAddress);
-        connectFutures.push_back(std::move(future));
-    }
+    std::vector<std::unique_ptr<LocalAddEntryTask>> localTasks;
+
+    if (!args.localTransportPath.empty()) {
+        LOG_INFO("Bookie local transport: " << args.localTransportPath);
+
+        try {
+            for (int i = 0; i < args.numberOfConnections; i++) {
+                localTasks.emplace_back(new LocalAddEntryTask(perConnectionRate, args.msgSize, args.batchSize,
+                        addEntryMetric));
+                localTasks.back()->start(args.localTransportPath);
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to connect to the bookie local transport: " << e.what());
+            std::exit(-1);
+        }
+    } else {
+        SocketAddress bookieAddress;
+        bookieAddress.setFromHostPort(args.bookieAddress);
+        LOG_INFO("Bookie address: " << bookieAddress);
+
+        client.group(std::make_shared<wangle::IOThreadPoolExecutor>(std::thread::hardware_concurrency()));
+        client.pipelineFactory(
+                std::make_shared<BookieClientPipelineFactory>(perConnectionRate, args.msgSize, args.batchSize,
+                        addEntryMetric));
+
+        std::vector<Future<BookieClientPipeline*>> connectFutures;
+        for (int i = 0; i < args.numberOfConnections; i++) {
+            auto future = client.connect(bookieAddress);
+            connectFutures.push_back(std::move(future));
+        }
 
-    for (auto& future : connectFutures) {
-        future.get();
+        for (auto& future : connectFutures) {
+            future.get();
+        }
     }
 
     while (true) {
@@ -0,0 +1,189 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "BookieCodecV2.h"
+#include "Logging.h"
+#include "PayloadArena.h"
+
+#include <boost/program_options.hpp>
+#include <folly/Format.h>
+#include <folly/io/Cursor.h>
+#include <wangle/channel/Pipeline.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace po = boost::program_options;
+using namespace std::chrono;
+
+DECLARE_LOG_OBJECT();
+
+struct Arguments {
+    int msgSize;
+    int numFrames;
+    int readSize;
+    int rounds;
+};
+
+/**
+ * Decode the frames split by the generic length field decoder, each frame in its own buffer, the way the bookie did
+ * before having the codec do the framing
+ */
+class FrameDecoder: public InboundHandler<IOBufPtr, Request> {
+public:
+    void read(Context* ctx, IOBufPtr buf) override {
+        io::Cursor reader { buf.get() };
+
+        Request request;
+        reader.readBE<int32_t>();
+        request.opCode = BookieOperation::AddEntry;
+        reader.skip(BookieConstant::MasterKeyLength);
+        request.ledgerId = reader.readBE<int64_t>();
+        request.entryId = reader.readBE<int64_t>();
+        request.data = payloadArena_.read(reader, reader.totalLength());
+        ctx->fireRead(std::move(request));
+    }
+
+private:
+    PayloadArena payloadArena_;
+};
+
+class FrameCounter: public InboundHandler<Request> {
+public:
+    void read(Context* ctx, Request request) override {
+        ++frames;
+    }
+
+    size_t frames = 0;
+};
+
+/**
+ * Serialize add entry requests back to back, as they are received from a client
+ */
+static IOBufPtr createFrames(int msgSize, int numFrames) {
+    const uint32_t frameSize = sizeof(int32_t) + BookieConstant::MasterKeyLength + 2 * sizeof(int64_t) + msgSize;
+    const size_t totalSize = (size_t) numFrames * (sizeof(int32_t) + frameSize);
+
+    IOBufPtr buf = IOBuf::create(totalSize);
+    buf->append(totalSize);
+    memset(buf->writableData(), 'X', totalSize);
+
+    // Protocol version 2, no flags
+    const int32_t header = (2 << 24) | ((int32_t) BookieOperation::AddEntry << 16);
+
+    io::RWPrivateCursor writer(buf.get());
+    for (int i = 0; i < numFrames; i++) {
+        writer.writeBE<int32_t>(frameSize);
+        writer.writeBE<int32_t>(header);
+        writer.skip(BookieConstant::MasterKeyLength);
+        writer.writeBE<int64_t>(i % 16);
+        writer.writeBE<int64_t>(i);
+        writer.skip(msgSize);
+    }
+
+    return buf;
+}
+
+/**
+ * Feed the frames to the pipeline in reads of the given size, like the socket handler does
+ *
+ * @return the decoded frames per second
+ */
+template<typename PipelineType>
+static double decodeFrames(PipelineType& pipeline, FrameCounter& counter, const IOBuf& frames, size_t readSize,
+        int numFrames) {
+    IOBufQueue queue(IOBufQueue::cacheChainLength());
+    counter.frames = 0;
+
+    steady_clock::time_point start = steady_clock::now();
+
+    for (size_t offset = 0; offset < frames.length(); offset += readSize) {
+        size_t length = std::min(readSize, frames.length() - offset);
+        queue.append(IOBuf::wrapBuffer(frames.data() + offset, length));
+        pipeline.read(queue);
+    }
+
+    double elapsedSeconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+    if (counter.frames != (size_t) numFrames) {
+        LOG_FATAL("Decoded " << counter.frames << " frames -- expecting: " << numFrames);
+        std::exit(-1);
+    }
+
+    return numFrames / elapsedSeconds;
+}
+
+int main(int argc, char** argv) {
+    Logging::init();
+
+    Arguments args;
+
+    po::options_description options;
+    options.add_options() //
+    ("help,h", "This help message") //
+    ("msg-size,s", po::value<int>(&args.msgSize)->default_value(100), "Message size") //
+    ("num-frames,n", po::value<int>(&args.numFrames)->default_value(1000000), "Number of frames decoded per round") //
+    ("read-size", po::value<int>(&args.readSize)->default_value(64 * 1024), "Size of each socket read") //
+    ("rounds,r", po::value<int>(&args.rounds)->default_value(5), "Number of rounds for each decoder") //
+            ;
+
+    po::variables_map map;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(options).run(), map);
+        po::notify(map);
+
+        if (map.count("help")) {
+            std::cerr << options << std::endl;
+            exit(1);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error parsing parameters -- " << e.what() << std::endl << std::endl;
+        std::cerr << options << std::endl;
+        return -1;
+    }
+
+    IOBufPtr frames = createFrames(args.msgSize, args.numFrames);
+
+    auto genericCounter = std::make_shared<FrameCounter>();
+    auto genericPipeline = Pipeline<IOBufQueue&, Unit>::create();
+    genericPipeline->addBack(LengthFieldBasedFrameDecoder(4, BookieConstant::MaxFrameSize));
+    genericPipeline->addBack(std::make_shared<FrameDecoder>());
+    genericPipeline->addBack(genericCounter);
+    genericPipeline->finalize();
+
+    auto fusedCounter = std::make_shared<FrameCounter>();
+    auto fusedPipeline = Pipeline<IOBufQueue&, Response>::create();
+    fusedPipeline->addBack(std::make_shared<BookieServerCodecV2>());
+    fusedPipeline->addBack(fusedCounter);
+    fusedPipeline->finalize();
+
+    for (int i = 0; i < args.rounds; i++) {
+        double generic = decodeFrames(*genericPipeline, *genericCounter, *frames, args.readSize, args.numFrames);
+        double fused = decodeFrames(*fusedPipeline, *fusedCounter, *frames, args.readSize, args.numFrames);
+
+        LOG_INFO(sformat("Round {} -- generic decoder: {:.0f} frames/s -- bookie decoder: {:.0f} frames/s -- {:.2f}x",
+                i, generic, fused, fused / generic));
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include "JournalIoEngine.h"
+#include "Logging.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <folly/Format.h>
+#include <folly/String.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+DECLARE_LOG_OBJECT();
+
+struct Arguments {
+    std::string engines;
+    std::string directory;
+    int msgSize;
+    int batchSize;
+    int numBatches;
+    int ioDepth;
+    bool fsync;
+    bool directIo;
+};
+
+/**
+ * Write batches of entries to a journal file through the given I/O engine, as fast as the engine allows, and report
+ * the throughput and the latency from the submission to the completion of each batch.
+ */
+static void runBenchmark(const Arguments& args, const std::string& engineType) {
+    fs::create_directories(args.directory);
+    std::unique_ptr<JournalIoEngine> engine = JournalIoEngine::create(engineType, args.fsync, args.ioDepth);
+
+    size_t batchBytes = (size_t) args.batchSize * (sizeof(RecordHeader) + args.msgSize);
+    size_t alignedBatchBytes = RecordBatch::alignedSize(batchBytes, AlignedBufferPool::Alignment);
+    AlignedBufferPool bufferPool(alignedBatchBytes, args.ioDepth + 2);
+
+    JournalFilePtr file = std::make_shared<JournalFile>(args.directory, 1, args.directIo,
+            args.directIo ? alignedBatchBytes * args.numBatches : 0);
+
+    std::string payload(args.msgSize, 'X');
+    uint32_t checksum = payloadChecksum(*IOBuf::wrapBuffer(payload.data(), payload.size()));
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(args.numBatches);
+
+    std::thread completionThread([&] {
+        engine->run([&](std::vector<JournalWritePtr>& writes, steady_clock::duration) {
+            steady_clock::time_point now = steady_clock::now();
+            for (auto& write : writes) {
+                if (!write->error.empty()) {
+                    LOG_FATAL("Journal write failed: " << write->error);
+                    std::exit(-1);
+                }
+
+                latencies.push_back(duration_cast<microseconds>(now - write->submitTime).count());
+            }
+        });
+    });
+
+    steady_clock::time_point start = steady_clock::now();
+    int64_t entryId = 0;
+
+    for (int i = 0; i < args.numBatches; i++) {
+        JournalWritePtr write = make_unique<JournalWrite>();
+        for (int j = 0; j < args.batchSize; j++) {
+            write->entries.emplace_back(
+                    LogEntry { 1, entryId++, IOBuf::wrapBuffer(payload.data(), payload.size()), checksum });
+        }
+
+        write->file = file;
+        write->records.reset(file->fileId(), write->entries);
+        if (args.directIo) {
+            write->alignedBuffer = bufferPool.get(alignedBatchBytes);
+            write->records.copyAligned(write->alignedBuffer.data(), AlignedBufferPool::Alignment);
+        }
+        write->offset = file->allocate(write->records.size());
+        engine->submit(std::move(write));
+    }
+
+    engine->close();
+    completionThread.join();
+
+    double elapsedSeconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    double entriesRate = (double) args.numBatches * args.batchSize / elapsedSeconds;
+    double throughputMB = (double) file->size() / elapsedSeconds / 1024 / 1024;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min<size_t>(latencies.size() - 1, latencies.size() * p)] / 1000.0;
+    };
+
+    LOG_INFO(sformat("{:>8} -- {:.0f} entries/s -- {:.1f} MB/s -- batch latency ms: " //
+            "pct50: {:.3f} pct99: {:.3f} pct999: {:.3f} max: {:.3f}",//
+            engineType, entriesRate, throughputMB, percentile(0.5), percentile(0.99), percentile(0.999),
+            percentile(1.0)));
+
+    fs::remove(JournalFile::path(args.directory, file->fileId()));
+}
+
+int main(int argc, char** argv) {
+    Logging::init();
+
+    Arguments args;
+
+    po::options_description options;
+    options.add_options() //
+    ("help,h", "This help message") //
+    ("engines,e", po::value<std::string>(&args.engines)->default_value("sync,io_uring"),
+            "Comma separated list of journal engines to compare") //
+    ("directory,d", po::value<std::string>(&args.directory)->default_value("./perf-journal"),
+            "Directory where to write the journal file") //
+    ("msg-size,s", po::value<int>(&args.msgSize)->default_value(1024), "Message size") //
+    ("batch-size,b", po::value<int>(&args.batchSize)->default_value(100), "Number of entries per batch") //
+    ("num-batches,n", po::value<int>(&args.numBatches)->default_value(10000), "Number of batches to write") //
+    ("io-depth", po::value<int>(&args.ioDepth)->default_value(8), "Max number of batches in flight") //
+    ("fsync", po::value<bool>(&args.fsync)->default_value(true), "Sync each batch") //
+    ("direct-io", po::value<bool>(&args.directIo)->default_value(false),
+            "Write with O_DIRECT into a preallocated file, from aligned buffers") //
+            ;
+
+    po::variables_map map;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(options).run(), map);
+        po::notify(map);
+
+        if (map.count("help")) {
+            std::cerr << options << std::endl;
+            exit(1);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error parsing parameters -- " << e.what() << std::endl << std::endl;
+        std::cerr << options << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> engines;
+    split(',', args.engines, engines);
+
+    for (const std::string& engine : engines) {
+        runBenchmark(args, engine);
+    }
+
+    return 0;
+}